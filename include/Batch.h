@@ -0,0 +1,48 @@
+#pragma once
+
+#include "NetOptimizer.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Many nets optimized in one process with a shared technology
+namespace Batch {
+
+struct NetResult {
+  std::string file;
+  bool ok = false;
+  std::string error;
+  float rat = 0.0f;
+  size_t buffers = 0;
+  double millis = 0.0;
+};
+
+// Net files listed in a manifest (one path per line, relative to the
+// manifest, '#' starts a comment) or all .json and .vgnet files of a
+// directory, where a .vgnet replaces the .json of the same name.
+// The technology file and earlier outputs are skipped. Throws if two nets
+// would write the same output file.
+std::vector<std::string> collectNets(const std::string &source,
+                                     const std::string &techFilename);
+
+// Optimize a single net on a (possibly reused) optimizer and write its
+// <stem>_out.json. Binary nets are optimized in place. Errors are reported
+// in the result instead of being thrown.
+NetResult optimizeNet(const std::string &testFilename,
+                      VG::NetOptimizer &optimizer,
+                      const std::vector<std::string> &cellNames,
+                      bool compact = false);
+
+// Runs nets largest file first on a pool of options.Threads threads, one
+// engine per thread. Every net itself runs serially with the other
+// options. Results keep the order of nets.
+std::vector<NetResult> run(const std::vector<std::string> &nets,
+                           const VG::TechParams &wireParams,
+                           const VG::BufferLibrary &library,
+                           const std::vector<std::string> &cellNames,
+                           const VG::Options &options, bool compact = false);
+
+// CSV: net,status,rat,buffers,ms, the net paths and errors quoted
+void writeSummary(std::ostream &out, const std::vector<NetResult> &results);
+
+} // namespace Batch
@@ -1,97 +1,248 @@
 #ifndef REPEATER_INSERTION_H
 #define REPEATER_INSERTION_H
 
+#include "CandidateList.h"
+#include "DPProfile.h"
+#include "ThreadPool.h"
+#include "VGTypes.h"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
 #include <limits>
-#include <list>
 #include <map>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace VG {
-// Physical parameters of the elements. C-capacitance. R - resistance.
-struct TechParams {
-  float C;
-  float R;
-  float IntrinsicDel;
-};
-
-// For convenience in presenting the solution
-struct BufPlace {
-  int ParentID;
-  int ChildID;
-  int Len;
-
-  bool operator!=(const BufPlace &Rhs) const {
-    return ParentID != Rhs.ParentID || ChildID != Rhs.ChildID || Len != Rhs.Len;
-  };
-  bool operator==(const BufPlace &Rhs) const { return !(*this != Rhs); }
-};
-
-struct Params {
-  float C;
-  float RAT;
-  std::vector<BufPlace> Buffers;
-
-  bool operator<(const Params &Rhs) const {
-    if (C < Rhs.C)
-      return true;
-    return RAT < Rhs.RAT;
-  }
-
-  bool operator==(const Params &Rhs) const {
-    return (std::fabs(C - Rhs.C) < std::numeric_limits<float>::epsilon()) &&
-           (std::fabs(RAT - Rhs.RAT) < std::numeric_limits<float>::epsilon());
-  }
-};
-
 // Representing a net routing tree as edges connecting syns, steiner points and buffer.
 struct Edge {
   int Start;
   int End;
   int Len;
-  bool IsVisited = false;
+  // Buffer sites every Pitch units from End, 0 takes Options::SitePitch.
+  // Distances from End inside a blocked range (ends included) hold no
+  // buffer.
+  int Pitch = 0;
+  std::vector<std::pair<int, int>> Blocked;
 };
 
 // Sink, steiner point or buffer
 struct Node {
   int ID;
-  std::vector<Node *> Children;
-  std::vector<int> Lens;
-  std::list<Params> CapsRATs;
+  CountedVector<Node *> Children;
+  CountedVector<int> Lens;
+  CandidateList CapsRATs;
 
   Node() = default;
   Node(int ID, const Params &CRAT) : ID(ID) { CapsRATs = {CRAT}; }
 };
 
+// Nodes of one routing tree, allocated in blocks that never move. reset()
+// keeps the blocks and the storage inside the nodes, so the next tree of a
+// similar size allocates almost nothing.
+class NodeArena {
+  static constexpr size_t BlockSize = 256;
+  std::vector<CountedVector<Node>> Blocks;
+  size_t Used = 0;
+  size_t PeakBytes = 0;
+
+public:
+  Node *create(int ID);
+  void reset();
+  size_t size() const { return Used; }
+  // Memory held by the nodes: blocks, child lists and candidate lists
+  size_t bytes() const;
+  size_t peakBytes() const { return std::max(PeakBytes, bytes()); }
+};
+
+// Optional engine behaviour
+struct Options {
+  // Validate every linear merge against the full cross product of branches
+  bool CheckedMerge = false;
+  // Verify after every step that candidate lists keep their cap order
+  bool CheckInvariants = false;
+  // Sibling subtrees are evaluated in parallel when above one. The result is
+  // the same as the serial one.
+  unsigned Threads = 1;
+  // Library cell of the net driver
+  int DriverCell = 0;
+  // Record per-node statistics of every run, see BufferInsertVG::profile()
+  bool Profile = false;
+  // Keep the candidates of every node after a run so that update() only
+  // redoes the changed paths. Children lists are copied instead of consumed.
+  bool Incremental = false;
+  // Distance between buffer sites along every wire without its own pitch
+  int SitePitch = 1;
+  // With a single useful buffer cell, see fastWires(), try buffers only at
+  // the analytic repeater spacing in the middle of long wires. Sites near both ends of the wire
+  // keep the exact search. Results may be slightly worse than exact.
+  bool FastWires = false;
+  // Relative tolerance of approximate pruning, see CandidateList::prune().
+  // 0 keeps the exact Pareto lists.
+  double Epsilon = 0;
+};
+
+// Changes to a solved tree for BufferInsertVG::update(), in engine IDs
+struct SinkChange {
+  int ID;
+  Params CRAT;
+};
+// New length of the wire from node ID to its parent
+struct EdgeChange {
+  int ID;
+  int Len;
+};
+struct Delta {
+  std::vector<SinkChange> Sinks;
+  std::vector<EdgeChange> Edges;
+};
+
+// Candidate lists of the last run as left by the prunes, and how the
+// merges of high-fanout nodes were spread over the pool
+struct PruneStats {
+  double Epsilon = 0;
+  // The RAT found is at most this much below the exact optimum
+  double RATBound = 0;
+  size_t Prunes = 0;
+  // Candidates dropped by approximation only
+  size_t Thinned = 0;
+  size_t LongestList = 0;
+  // Sum of list lengths, over Prunes gives the mean
+  size_t TotalLength = 0;
+  // Merge rounds run on the pool, and the pair merges of those rounds
+  // that another thread than the round's own took
+  size_t ParallelMerges = 0;
+  size_t StolenMerges = 0;
+};
+
 class BufferInsertVG {
+  // A node together with the edge from its parent, Idx is the position of
+  // the node among the parent children
+  struct Visit {
+    Node *N;
+    Node *Parent;
+    size_t Idx;
+  };
+
+  NodeArena Nodes;
   Node *Root;
-  int CountSinks;
+  int CountSinks = 0;
+  // One past the largest node ID of the tree
+  int CountIDs = 1;
   TechParams UnitWire;
-  TechParams Buffer;
-
-  void buildRecursive(Node *node, std::vector<Edge> &Edges,
-                      std::vector<Node> &Sinks) const;
-  std::list<Params> recursiveVanGin(Node *node);
-  void addWire(std::list<Params> &List, Node *Parent, Node *Child, int Len);
-  void insertBuffer(std::list<Params> &List, Node *Parent, Node *Child,
-                    int Len);
-  std::list<Params> mergeBranch(std::list<Params> &First,
-                                std::list<Params> &Second, Node *Parent);
-  std::list<Params> mergeBranches(std::vector<std::list<Params>> &CldParams,
-                                  Node *Parent);
-  void pruneSolutions(std::list<Params> &Solutions);
-
-public:
-  BufferInsertVG(const TechParams &UnitWire, const TechParams &Buffer) : UnitWire(UnitWire), Buffer(Buffer) {
-    Root = new Node;
-    Root->ID = 0;
+  BufferLibrary Library;
+  // Cells worth trying at a buffer site, by growing input cap. Cells that are
+  // no better than another one in cap, resistance and delay are left out.
+  std::vector<int> SiteCells;
+  Options Opts;
+  // One history arena per thread: the caller first, then the pool workers
+  std::deque<SolutionArena> Arenas;
+  std::unique_ptr<ThreadPool> Pool;
+  std::unique_ptr<DPProfile> Profile;
+  // Per thread like Arenas, summed by pruneStats()
+  std::vector<PruneStats> Pruning;
+  double RATBound = 0;
+  // Last run: nodes in post order, position of every ID in it and the
+  // candidates of every node up to its parent (all of them if incremental)
+  std::vector<Visit> Visits;
+  std::vector<size_t> VisitPos;
+  CountedVector<CandidateList> Solved;
+  // History records live after the last full run or compaction. Updates
+  // compact once the arenas hold twice as many.
+  size_t LiveRecords = 0;
+  // Buffer sites on the wire above every node, by node ID. Blocked ranges
+  // are sorted and disjoint.
+  struct SiteRule {
+    int Pitch = 0;
+    std::vector<std::pair<int, int>> Blocked;
   };
+  std::vector<SiteRule> Sites;
+  // Delay per unit length of a buffered wire is the lowest with stages this
+  // long, 0 if the fast path is off
+  int Spacing = 0;
+  // Subtrees with less wire length and nodes than ForkCutoff are not worth
+  // a task
+  static constexpr long ForkCutoff = 64;
+  // Merge rounds of fewer candidates than MergeCutoff run on one thread
+  static constexpr size_t MergeCutoff = 512;
+
+  SolutionArena &history();
+  PruneStats &pruning() {
+    return Pruning[Pool ? Pool->currentWorker() + 1 : 0];
+  }
+  // Statistics of the node if the run is profiled, null otherwise
+  NodeProfile *profiled(int ID) {
+    return Profile ? &Profile->node(ID) : nullptr;
+  }
+  template <class SinkInit>
+  void buildTree(std::span<const Edge> Edges, size_t Sinks, SinkInit InitSink);
+  std::vector<Visit> postOrder() const;
+  // First legal site at distance From or above from the node, or -1
+  int nextSite(const SiteRule &Rule, int From, int Last) const;
+  // Same on a long wire of the fast path: every unit in the windows at both
+  // ends, evenly spaced stages of about Spacing in between
+  int fastSite(int From, int Last) const;
+  void extendToParent(CandidateList &List, const Visit &V);
+  void solveNode(const Visit &V, CountedVector<CandidateList> &Solved);
+  void solveParallel(const std::vector<Visit> &Order,
+                     CountedVector<CandidateList> &Solved);
+  Solution solveDriver();
+  void compactHistory();
+  void addWire(CandidateList &List, Node *Child, int Len);
+  void insertBuffer(CandidateList &List, Node *Parent, Node *Child, int Len);
+  void prune(CandidateList &List, Node *N);
+  void checkOrder(const CandidateList &List, bool Pruned, Node *N,
+                  const char *Step) const;
+  CandidateList mergeBranch(CandidateList &First, CandidateList &Second,
+                            Node *Parent);
+  CandidateList mergeCrossProduct(CandidateList &First, CandidateList &Second);
+  void checkMerge(CandidateList &First, CandidateList &Second,
+                  const CandidateList &Merged);
+  CandidateList mergeBranches(CountedVector<CandidateList> &CldParams,
+                              Node *Parent);
 
-  void buildRoutingTree(std::vector<Edge> &Edges, std::vector<Node> &Sinks);
-  Params getOptimParams();
+public:
+  BufferInsertVG(const TechParams &UnitWire, const BufferLibrary &Library,
+                 const Options &Opts = {});
+  BufferInsertVG(const TechParams &UnitWire, const TechParams &Buffer,
+                 const Options &Opts = {})
+      : BufferInsertVG(UnitWire, BufferLibrary{Buffer}, Opts) {}
+
+  // Replaces the previous tree, if any. Sink I of the span has ID I + 1,
+  // the inputs are only read.
+  void buildRoutingTree(std::span<const Edge> Edges,
+                        std::span<const Node> Sinks);
+  void buildRoutingTree(std::span<const Edge> Edges,
+                        std::span<const Params> Sinks);
+  Solution getOptimParams();
+  // Applies the changes to the tree of the last incremental run and solves
+  // again only the nodes between a change and the root. The result is the
+  // one getOptimParams() gives on the changed tree.
+  Solution update(const Delta &Changes);
+  // Drop the tree and the solution history but keep their memory, so one
+  // instance can optimize net after net
+  void reset();
+  void setDriverCell(int Cell);
+  // Largest memory the tree nodes have held
+  size_t peakTreeBytes() const { return Nodes.peakBytes(); }
+  // Statistics of the last run, null unless Options::Profile is set
+  const DPProfile *profile() const { return Profile.get(); }
+  // List sizes and the RAT bound of the last run or update
+  PruneStats pruneStats() const;
+  // Solution history records held by all threads
+  size_t historyRecords() const;
+  // Cells worth a try at a buffer site: no other cell is at least as good
+  // in every parameter. Sorted by input cap.
+  static std::vector<int> usefulCells(const BufferLibrary &Library);
+  // True if Options::FastWires takes effect: one useful cell and a wire
+  // with both resistance and cap
+  static bool fastWires(const TechParams &UnitWire,
+                        const BufferLibrary &Library);
 };
 
 } //namespace VG
@@ -0,0 +1,34 @@
+#ifndef CANDIDATE_KERNELS_H
+#define CANDIDATE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Vector kernels over the structure-of-arrays candidate store. The widest
+// instruction set supported by the CPU is picked on first use, select() can
+// force a narrower one (tests, benchmarks).
+namespace VG::Kernels {
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+Isa active();
+// Returns false if the CPU does not support Target
+bool select(Isa Target);
+const char *name(Isa Target);
+
+// Wire transform: RAT = RAT - WireR * C + OffsetRAT, C = C + OffsetC
+void applyWire(double *C, double *RAT, size_t N, double WireR, double OffsetC,
+               double OffsetRAT);
+
+// Buffer transform: index of the candidate with the largest RAT - R * C.
+// The first one wins on ties. N must be positive.
+size_t bestBuffered(const double *C, const double *RAT, size_t N, double R);
+
+// Dominance sweep over candidates sorted by caps (ties by RAT descending):
+// writes indices of candidates whose RAT exceeds every RAT before them and
+// returns their count.
+size_t selectNonDominated(const double *RAT, size_t N, uint32_t *Kept);
+
+} // namespace VG::Kernels
+
+#endif // CANDIDATE_KERNELS_H
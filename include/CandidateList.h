@@ -0,0 +1,148 @@
+#ifndef CANDIDATE_LIST_H
+#define CANDIDATE_LIST_H
+
+#include "VGTypes.h"
+#include <algorithm>
+#include <initializer_list>
+#include <set>
+#include <vector>
+
+namespace VG {
+
+// Upper envelope of lines RAT - X * C over the stored candidates. Answers
+// "which candidate gives the best RAT behind a driver with resistance X" in
+// logarithmic time, lines that are never optimal are dropped on insertion.
+class RATHull {
+  struct Line {
+    // Slope (-C), intercept (RAT) and the X where the line stops being optimal
+    double Slope;
+    double Intercept;
+    mutable double End;
+    const SolutionRecord *Hist;
+
+    bool operator<(const Line &Rhs) const { return Slope < Rhs.Slope; }
+    bool operator<(double X) const { return End < X; }
+  };
+  using LineSet =
+      std::multiset<Line, std::less<>, CountingAllocator<Line>>;
+  LineSet Lines;
+
+  bool intersect(LineSet::iterator First, LineSet::iterator Second);
+
+public:
+  void add(double C, double RAT, const SolutionRecord *Hist);
+  // Best RAT - X * C and the history it comes from
+  std::pair<double, const SolutionRecord *> query(double X) const;
+  bool empty() const { return Lines.empty(); }
+  void clear() { Lines.clear(); }
+};
+
+// Candidate solutions of a subtree with a lazily applied wire transform.
+// Stored values are raw, the actual values are
+//   C = C_raw + OffsetC,  RAT = RAT_raw - WireR * C_raw + OffsetRAT,
+// so extending the wire only updates three numbers (Shi-Li style). The
+// candidates are free of dominated solutions only after prune().
+//
+// Caps stay ordered by construction: they ascend up to BufferedBegin and
+// descend over the buffered tail (a later buffer sees more wire, so its raw
+// cap is smaller). A wire step shifts all caps alike, so prune() merges the
+// two runs in one pass instead of sorting.
+//
+// Storage is a structure of arrays for the vector kernels. Values are double:
+// offsets of a long wire are large and would eat the float mantissa.
+class CandidateList {
+  CountedVector<double> Caps;
+  CountedVector<double> RATs;
+  CountedVector<const SolutionRecord *> Hists;
+  // Start of candidates appended by insertBuffer since the last prune
+  size_t BufferedBegin = 0;
+  // False once push_back broke the cap order, prune() sorts then
+  bool Sorted = true;
+  // Candidates dropped as dominated over the life of the list
+  size_t Dropped = 0;
+  // The best RAT built on this list may be this much below the exact one,
+  // lost to approximate pruning here and in the lists it was built from
+  double Slack = 0;
+  double WireR = 0;
+  double OffsetC = 0;
+  double OffsetRAT = 0;
+  // Short lists are scanned by a vector kernel, longer ones switch to the
+  // envelope until the next prune
+  static constexpr size_t HullThreshold = 32;
+  bool HullBuilt = false;
+  RATHull Hull;
+
+  double actualRAT(size_t I) const {
+    return RATs[I] - WireR * Caps[I] + OffsetRAT;
+  }
+  void pushRaw(double C, double RAT, const SolutionRecord *Hist);
+  void popBack();
+  void applyPending();
+  // Prune paths for ordered and for arbitrary candidates
+  void mergeSweep();
+  void sortSweep();
+  size_t thin(double Epsilon);
+  // Best RAT - R * C over the candidates and the history it comes from
+  std::pair<double, const SolutionRecord *> bestDriven(double R);
+  // Add a buffered candidate to the tail in cap order, dropping earlier
+  // buffered ones it dominates
+  void pushBuffered(double C, double RAT, const SolutionRecord *Hist);
+
+public:
+  CandidateList() = default;
+  CandidateList(std::initializer_list<Params> Init) {
+    for (const auto &P : Init)
+      push_back(P);
+  }
+
+  size_t size() const { return Caps.size(); }
+  bool empty() const { return Caps.empty(); }
+  // Candidate with the pending transform applied
+  Params at(size_t I) const {
+    return Params{float(Caps[I] + OffsetC), float(actualRAT(I)), Hists[I]};
+  }
+  void push_back(const Params &Actual);
+  // Drop every candidate, the storage is kept
+  void clear();
+  // Heap memory held by the list
+  size_t capacityBytes() const;
+  // Points every history at Move(history), when the records are moved to
+  // another arena
+  template <class MoveFn> void moveHistories(MoveFn Move) {
+    for (auto &Hist : Hists)
+      Hist = Move(Hist);
+    Hull.clear();
+    HullBuilt = false;
+  }
+  size_t dropped() const { return Dropped; }
+  double slack() const { return Slack; }
+  // A list built from others inherits the largest of their slacks
+  void raiseSlack(double S) { Slack = std::max(Slack, S); }
+
+  // O(1): extend every candidate by Len units of wire
+  void addWire(const TechParams &UnitWire, int Len);
+  // Add the best candidate driven by a buffer placed at Place, O(log n) once
+  // the list is long. Returns the new candidate.
+  Params insertBuffer(const TechParams &Buffer, const BufPlace &Place,
+                      SolutionArena &History);
+  // Same for every cell of Cells (sorted by input cap) at one site. A cell
+  // is kept only if it beats the RAT of all cells with smaller caps.
+  void insertBuffers(const BufferLibrary &Library,
+                     const std::vector<int> &Cells, BufPlace Place,
+                     SolutionArena &History);
+  // Apply the pending transform and drop dominated candidates, the result
+  // is sorted by caps. With a positive Epsilon a candidate is also dropped
+  // when the one kept before it is within Epsilon in cap and in RAT
+  // (relative). Returns how many went that way, the RAT given up is added
+  // to the slack.
+  size_t prune(double Epsilon = 0);
+
+  // Invariant checks for debugging, both O(n): caps ordered as described
+  // above, and right after prune() strictly growing caps and RATs
+  bool ordered() const;
+  bool pruned() const;
+};
+
+} // namespace VG
+
+#endif // CANDIDATE_LIST_H
@@ -0,0 +1,84 @@
+#ifndef DP_PROFILE_H
+#define DP_PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace VG {
+
+// Work of the dynamic program spent on one tree node
+enum class Phase { Wire, Buffer, Prune, Merge };
+constexpr int PhaseCount = 4;
+
+struct NodeProfile {
+  int ID = -1;
+  int Parent = -1;
+  int Children = 0;
+  // Thread that solved the node: 0 is the caller, then the pool workers
+  int Thread = 0;
+  // Candidates made by merges and buffers (the sink itself for leaves),
+  // dropped as dominated, and left after the wire to the parent
+  size_t Created = 0;
+  size_t Pruned = 0;
+  size_t Surviving = 0;
+  size_t PeakLength = 0;
+  uint64_t Nanos[PhaseCount] = {};
+  // Nanoseconds from the start of the run: node begin, end of the children
+  // merge (where the wire to the parent starts), node end
+  uint64_t Start = 0;
+  uint64_t MergeEnd = 0;
+  uint64_t End = 0;
+};
+
+// Per-node statistics of one getOptimParams() run. Every node is solved by
+// one thread, so the records need no locking. Timing every wire step costs
+// far more than the step itself, compare phases of profiled runs only.
+class DPProfile {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point Origin;
+  std::vector<NodeProfile> Nodes;
+
+public:
+  // Forget the previous run, IDs are below CountIDs
+  void start(int CountIDs);
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                Origin)
+        .count();
+  }
+  NodeProfile &node(int ID) { return Nodes[ID]; }
+  // Solved nodes only
+  std::vector<NodeProfile> nodes() const;
+
+  // Chrome trace event format, opens in chrome://tracing and Perfetto
+  void writeChromeTrace(std::ostream &OS) const;
+  // One line per node
+  void writeCSV(std::ostream &OS) const;
+};
+
+// Adds the time of a scope to a phase of the node, a null node is not timed
+class PhaseTimer {
+  const DPProfile *Profile;
+  NodeProfile *Node;
+  Phase P;
+  uint64_t Begin = 0;
+
+public:
+  PhaseTimer(const DPProfile *Profile, NodeProfile *Node, Phase P)
+      : Profile(Profile), Node(Node), P(P) {
+    if (Node)
+      Begin = Profile->now();
+  }
+  ~PhaseTimer() {
+    if (Node)
+      Node->Nanos[int(P)] += Profile->now() - Begin;
+  }
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+
+} // namespace VG
+
+#endif // DP_PROFILE_H
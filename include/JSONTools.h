@@ -1,7 +1,11 @@
 #pragma once
 
 #include "BufferInsertVG.h"
+#include <array>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace JSONTools {
@@ -31,17 +35,143 @@ VG::TechParams parseTechFile(const std::string &filename);
 
 VG::TechParams parseBufferParams(const std::string &filename);
 
+// All buffer modules of the tech file, cellNames gets their names
+VG::BufferLibrary parseBufferLibrary(const std::string &filename,
+                                     std::vector<std::string> &cellNames);
+
+// Unit wire and buffer library from one read of the tech file
+void parseTechnology(const std::string &filename, VG::TechParams &wireParams,
+                     VG::BufferLibrary &library,
+                     std::vector<std::string> &cellNames);
+// Same for tech file contents already in memory, filename is for messages
+void parseTechnologyText(const std::string &text, const std::string &filename,
+                         VG::TechParams &wireParams, VG::BufferLibrary &library,
+                         std::vector<std::string> &cellNames);
+
+// Streams the net file through a SAX parser over a memory mapping
 InputData parseTestFile(const std::string &filename);
+// Same for a net already in memory, name is for messages
+InputData parseTestText(std::string_view text, const std::string &name);
 
 void convertToVGStructures(InputData &inputData, std::vector<VG::Edge> &edges,
                            std::vector<VG::Node> &nodes,
                            std::map<int, int> &originalToNewId,
                            std::map<int, int> &newToOriginalId);
 
+// One ECO step in original IDs: sinks with a new capacitance and/or RAT,
+// rerouted edges with new segments. The tree topology stays.
+struct SinkUpdate {
+  int id;
+  std::optional<float> capacitance;
+  std::optional<float> rat;
+};
+
+struct EdgeUpdate {
+  int id;
+  std::vector<std::vector<int>> segments;
+};
+
+struct NetDelta {
+  std::vector<SinkUpdate> sinks;
+  std::vector<EdgeUpdate> edges;
+};
+
+// Delta file: an object with "node" and "edge" arrays laid out like the net
+// file, or an array of such objects applied one after another
+std::vector<NetDelta> parseDeltaFile(const std::string &filename);
+
+// Applies the step to the net and returns it in engine IDs for
+// BufferInsertVG::update()
+VG::Delta applyDelta(InputData &inputData, const NetDelta &delta,
+                     const std::map<int, int> &originalToNewId);
+
+// Where buffers may go: a pitch for the net and for single edges, ranges
+// of distances from the child of an edge, and floorplan blockages as
+// rectangles {x1, y1, x2, y2} (borders included)
+struct SiteMap {
+  int pitch = 0;
+  std::map<int, int> edgePitch;
+  std::map<int, std::vector<std::pair<int, int>>> edgeBlocked;
+  std::vector<std::array<int, 4>> blockages;
+};
+
+SiteMap parseSiteFile(const std::string &filename);
+
+// Sets pitch and blocked ranges of the edges made by convertToVGStructures().
+// The net pitch is left to VG::Options::SitePitch.
+void applySiteMap(const SiteMap &sites, const InputData &inputData,
+                  std::vector<VG::Edge> &edges,
+                  const std::map<int, int> &originalToNewId);
+
+// Library cell named like the driver node, the first cell if none is
+int findDriverCell(const InputData &inputData,
+                   const std::vector<std::string> &cellNames);
+
+// The net with the buffers inserted: new nodes after the original ones and
+// the edges they split replaced by pieces. Buffers are named after their
+// library cell when cellNames is given, after the driver otherwise.
+InputData bufferedNet(const InputData &originalData,
+                      const std::vector<VG::BufPlace> &bufferLocations,
+                      const std::map<int, int> &newToOriginalId,
+                      const std::vector<std::string> &cellNames = {},
+                      bool verbose = false);
+
+// <input stem>_out.json, in the working directory
+std::string outputFilename(const std::string &inputFilename);
+
+// Writes <input stem>_out.json to the working directory. Inserted buffers
+// are named after their library cell when cellNames is given, after the
+// driver otherwise. verbose reports every inserted buffer and the output
+// name on stdout, compact leaves out all whitespace.
 void writeOutputFile(const std::string &originalFilename,
                      const InputData &originalData,
                      const std::vector<VG::BufPlace> &bufferLocations,
-                     const std::map<int, int> &newToOriginalId);
+                     const std::map<int, int> &newToOriginalId,
+                     bool verbose = true,
+                     const std::vector<std::string> &cellNames = {},
+                     bool compact = false);
+
+// Serializes a net straight into one buffer, in the input layout (keys in
+// input order, 4-space indent, a point per line) or without whitespace when
+// compact. Every node goes in first, then every edge followed by its
+// points, then finish().
+class NetWriter {
+  std::basic_string<char, std::char_traits<char>, VG::CountingAllocator<char>>
+      out;
+  bool compact;
+  bool inEdges = false;
+  bool edgeOpen = false;
+  // Written in the current section and edge
+  size_t items = 0;
+  size_t points = 0;
+
+  void newline(int indent);
+  void integer(int value);
+  void real(float value);
+  void string(std::string_view text);
+  void key(const char *name, int indent);
+  void beginEdges();
+  void closeEdge();
+
+public:
+  // reserve is the expected size of the text
+  explicit NetWriter(bool compact, size_t reserve = 0);
+
+  // Load and RAT are written for sinks only
+  void node(int id, int x, int y, std::string_view type, std::string_view name,
+            float capacitance, float rat);
+  void edge(int id, std::span<const int> vertices);
+  void point(int x, int y);
+  void finish();
+
+  std::string text() const;
+  void save(const std::string &filename) const;
+};
+
+// Writes a net in the input format
+void writeTestFile(const std::string &filename, const InputData &data,
+                   bool compact = false);
+std::string writeTestText(const InputData &data, bool compact = false);
 
 std::vector<std::vector<int>>
 extractSegmentsBetween(const std::vector<std::vector<int>> &segments,
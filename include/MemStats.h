@@ -0,0 +1,83 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace VG {
+
+// Part of a run the allocations are charged to, per thread
+enum class MemPhase { Other, Build, DP, Merge, Output };
+constexpr int MemPhaseCount = 5;
+const char *memPhaseName(MemPhase P);
+
+struct MemCounters {
+  uint64_t Allocations = 0;
+  // Allocated in total, frees are not subtracted
+  uint64_t Bytes = 0;
+  // Largest live bytes of all counted containers seen while allocating
+  uint64_t PeakLive = 0;
+};
+
+struct MemReport {
+  MemCounters Total;
+  uint64_t Live = 0;
+  MemCounters Phases[MemPhaseCount];
+
+  void print(std::ostream &OS) const;
+};
+
+// Process-wide counters of the containers using CountingAllocator: the
+// candidate lists, solution histories, tree nodes and the output writer.
+// Updates are relaxed atomics, threads may allocate concurrently.
+namespace MemStats {
+
+void allocated(size_t Bytes);
+void freed(size_t Bytes);
+MemReport report();
+// Zero the totals, peaks restart from the live bytes
+void reset();
+MemPhase currentPhase();
+
+} // namespace MemStats
+
+// Charges allocations of the calling thread to P until the end of the scope
+class MemPhaseScope {
+  MemPhase Saved;
+
+public:
+  explicit MemPhaseScope(MemPhase P);
+  ~MemPhaseScope();
+  MemPhaseScope(const MemPhaseScope &) = delete;
+  MemPhaseScope &operator=(const MemPhaseScope &) = delete;
+};
+
+template <class T> struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template <class U> CountingAllocator(const CountingAllocator<U> &) {}
+
+  T *allocate(size_t N) {
+    auto *P = std::allocator<T>().allocate(N);
+    MemStats::allocated(N * sizeof(T));
+    return P;
+  }
+  void deallocate(T *P, size_t N) {
+    MemStats::freed(N * sizeof(T));
+    std::allocator<T>().deallocate(P, N);
+  }
+
+  template <class U> bool operator==(const CountingAllocator<U> &) const {
+    return true;
+  }
+};
+
+template <class T> using CountedVector = std::vector<T, CountingAllocator<T>>;
+
+} // namespace VG
+
+#endif // MEM_STATS_H
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "JSONTools.h"
+#include "MappedFile.h"
+#include "NetOptimizer.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary routed-net format. A file is a header followed by flat arrays:
+//   Header | NodeRecord[nodes] | EdgeRecord[edges] | Point[points] | chars
+// Edges own a contiguous run of points, node type and name are slices of
+// the trailing string table. Everything is 4-byte aligned in native byte
+// order, so a mapped file is used in place: edge and point records are the
+// ones NetOptimizer reads.
+namespace NetFormat {
+
+constexpr char Magic[8] = {'V', 'G', 'N', 'E', 'T', 'B', 'I', 'N'};
+constexpr uint32_t Version = 1;
+constexpr uint32_t ByteOrderMark = 0x01020304;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t nodeCount;
+  uint64_t edgeCount;
+  uint64_t pointCount;
+  uint64_t stringBytes;
+};
+
+struct StringRef {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct NodeRecord {
+  int32_t id;
+  int32_t x;
+  int32_t y;
+  float capacitance;
+  float rat;
+  StringRef type;
+  StringRef name;
+};
+
+using EdgeRecord = VG::NetEdge;
+using Point = VG::NetPoint;
+
+// Validated view of a mapped binary net, no data is copied
+class NetFile {
+  JSONTools::MappedFile file;
+  const Header *header;
+  const NodeRecord *nodes_;
+  const EdgeRecord *edges_;
+  const Point *points_;
+  const char *strings;
+  // Nodes as NetOptimizer takes them, made by the first view()
+  std::vector<VG::NetNode> netNodes;
+
+public:
+  explicit NetFile(const std::string &filename);
+
+  size_t nodeCount() const { return header->nodeCount; }
+  size_t edgeCount() const { return header->edgeCount; }
+  size_t pointCount() const { return header->pointCount; }
+  const NodeRecord &node(size_t i) const { return nodes_[i]; }
+  const EdgeRecord &edge(size_t i) const { return edges_[i]; }
+  const Point *points(const EdgeRecord &edge) const {
+    return points_ + edge.FirstPoint;
+  }
+  std::string_view string(StringRef ref) const {
+    return {strings + ref.offset, ref.length};
+  }
+
+  // The net for NetOptimizer. Edges and points are the mapped records,
+  // only the node kinds are decoded into one flat array.
+  VG::NetView view();
+  // First node of type "b", throws if there is none
+  const NodeRecord &driver() const;
+  // Library cell named like the driver node, the first cell if none is
+  int driverCell(const std::vector<std::string> &cellNames) const;
+
+  // Full copy into the editable form, for conversion and net edits
+  JSONTools::InputData toInputData() const;
+};
+
+// True if the file starts with the binary net magic
+bool isBinaryNet(const std::string &filename);
+
+// Net file in either format as an editable InputData, picked by the magic
+// bytes. Binary nets are copied, NetFile::view() optimizes them in place.
+JSONTools::InputData readNet(const std::string &filename);
+
+// Name of the library cell of a placed buffer, the driver's name if
+// cellNames does not have the cell
+std::string_view bufferName(const NetFile &net, const VG::PlacedBuffer &buffer,
+                            const std::vector<std::string> &cellNames);
+
+// The optimized net in the input format, laid out like the buffered net of
+// JSONTools::bufferedNet(): the nodes, the buffers, the pieces of the split
+// edges, the other edges. Buffers are named after their library cell when
+// cellNames is given, after the driver otherwise.
+JSONTools::NetWriter bufferedNet(const NetFile &net,
+                                 const VG::BufferedNet &result,
+                                 const std::vector<std::string> &cellNames,
+                                 bool compact = false);
+
+// Writes <input stem>_out.json like JSONTools::writeOutputFile()
+void writeOutputFile(const std::string &originalFilename, const NetFile &net,
+                     const VG::BufferedNet &result, bool verbose = true,
+                     const std::vector<std::string> &cellNames = {},
+                     bool compact = false);
+
+void writeBinaryNet(const std::string &filename,
+                    const JSONTools::InputData &data);
+
+// Converts between the formats, the direction follows the input format.
+// compact JSON has no whitespace. Returns true if the output is binary.
+bool convertNet(const std::string &input, const std::string &output,
+                bool compact = false);
+
+} // namespace NetFormat
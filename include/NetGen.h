@@ -0,0 +1,51 @@
+#pragma once
+
+#include "JSONTools.h"
+#include <cstdint>
+#include <string>
+
+// Seeded generator of synthetic routed nets for stress and scaling runs.
+// The same options and seed give the same net on every platform: the
+// random numbers come from std::mt19937_64 and are mapped to ranges here
+// rather than by the implementation-defined std distributions.
+namespace NetGen {
+
+enum class Shape {
+  Steiner, // sinks scattered over the die, joined by recursive partitioning
+  Chain,   // Steiner points in a row across the die, one sink hangs off each
+  HTree,   // binary H-tree from the die center, sinks rounded up to 2^k
+  Star     // one hub at the die center drives every sink
+};
+
+// Value distribution of sink capacitance or RAT
+struct Distribution {
+  enum class Kind { Uniform, Normal } kind = Kind::Uniform;
+  float a = 0.0f; // lower bound or mean
+  float b = 0.0f; // upper bound or standard deviation
+
+  // "uniform:LO:HI", "normal:MEAN:SD" or a constant
+  static Distribution parse(const std::string &spec);
+};
+
+struct Options {
+  Shape shape = Shape::Steiner;
+  int sinks = 100;
+  // Side of the square die in wire units, sets the wire lengths
+  int span = 1000;
+  // Largest fanout of a Steiner point in Steiner trees
+  int fanout = 3;
+  uint64_t seed = 1;
+  Distribution capacitance{Distribution::Kind::Uniform, 0.5f, 5.0f};
+  Distribution rat{Distribution::Kind::Uniform, 1000.0f, 2000.0f};
+  // Name of the driver node, selects the driver cell
+  std::string driver = "buf1x";
+};
+
+Shape parseShape(const std::string &name);
+const char *shapeName(Shape shape);
+
+// Net with driver 0 and nodes numbered in creation order. Every edge runs
+// from the parent to the child as a rectilinear polyline.
+JSONTools::InputData generate(const Options &options);
+
+} // namespace NetGen
@@ -0,0 +1,96 @@
+#ifndef NET_OPTIMIZER_H
+#define NET_OPTIMIZER_H
+
+#include "BufferInsertVG.h"
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace VG {
+
+// Routed net owned by the caller and read in place. Node IDs and edge IDs
+// are the caller's own. An edge runs from the parent (From) to the child
+// (To) along Points[FirstPoint, FirstPoint + PointCount), which starts at
+// the parent and ends at the child.
+enum class NodeKind : uint8_t { Driver, Steiner, Sink };
+
+struct NetPoint {
+  int X;
+  int Y;
+};
+
+struct NetNode {
+  int ID;
+  int X;
+  int Y;
+  NodeKind Kind;
+  // Sinks only
+  float C = 0;
+  float RAT = 0;
+};
+
+struct NetEdge {
+  int ID;
+  int From;
+  int To;
+  uint32_t FirstPoint;
+  uint32_t PointCount;
+};
+
+struct NetView {
+  std::span<const NetNode> Nodes;
+  std::span<const NetEdge> Edges;
+  std::span<const NetPoint> Points;
+};
+
+struct PlacedBuffer {
+  // New node ID, above every node ID of the net
+  int ID;
+  int Cell;
+  NetPoint At;
+  // Edge of the net the buffer sits on and its distance from the child
+  int Edge;
+  int Distance;
+};
+
+// The buffered net as a change of the caller's net: the edges in Split are
+// replaced by Pieces, every other edge stays. Pieces get edge IDs above
+// those of the net and index Points.
+struct BufferedNet {
+  float RAT = 0;
+  std::vector<PlacedBuffer> Buffers;
+  std::vector<int> Split;
+  std::vector<NetEdge> Pieces;
+  std::vector<NetPoint> Points;
+};
+
+// Optimizes nets given as views, no files or text formats involved. The
+// engine and the scratch space are kept from net to net.
+class NetOptimizer {
+  BufferInsertVG Engine;
+  std::unordered_map<int, int> EngineID;
+  std::vector<Edge> Edges;
+  std::vector<Params> Sinks;
+  // Net edge of every engine node, by engine ID
+  std::vector<int> EdgeOf;
+
+  void placeBuffers(const NetView &Net, const Solution &Best,
+                    BufferedNet &Result) const;
+
+public:
+  NetOptimizer(const TechParams &UnitWire, const BufferLibrary &Library,
+               const Options &Opts = {});
+
+  // For nets given in the engine's own structures, and for statistics
+  BufferInsertVG &engine() { return Engine; }
+
+  // The driver is of library cell DriverCell. RAT, buffer sites and IDs are
+  // the ones the file flow gives for the same net, positions are exact
+  // where the file flow may round a unit off.
+  BufferedNet optimize(const NetView &Net, int DriverCell = 0);
+};
+
+} // namespace VG
+
+#endif // NET_OPTIMIZER_H
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "TechLibrary.h"
+#include <string>
+
+// Optimizer daemon: the technology is loaded once and nets come in as
+// requests. Every message either way is a frame
+//   <payload bytes in decimal>\n<payload>
+// with a JSON object as payload. A request holds an optional "id" that is
+// echoed back and either "net" (a net object laid out like the net file) or
+// "file" (path of a .json or .vgnet net). "topology": true also returns the
+// buffered net. The reply is
+//   {"id": ..., "ok": true, "rat": R, "buffers": [{"id", "name", "x", "y"}],
+//    "ms": T[, "net": {...}]}
+// or {"id": ..., "ok": false, "error": "..."}. Requests run concurrently on
+// a pool, so replies may come in another order than the requests.
+namespace Server {
+
+// Frames from fd in, replies to fd out, until in ends. Returns once every
+// reply is written, neither fd is closed.
+void serveStream(int in, int out, const JSONTools::TechLibrary &tech,
+                 unsigned threads);
+
+// Frames from stdin, replies to stdout, until stdin ends
+void serveStdio(const JSONTools::TechLibrary &tech, unsigned threads);
+
+// Frames from every client of a Unix domain socket at path, each client
+// gets its replies on its own connection. Runs until the process ends or
+// accepting fails; then it throws once the open connections are answered.
+// Throws if path exists and is not a socket, the socket is mode 0600.
+void serveSocket(const std::string &path, const JSONTools::TechLibrary &tech,
+                 unsigned threads);
+
+} // namespace Server
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "VGTypes.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace JSONTools {
+
+// Technology of a run: the unit wire and the buffer cells. The tech JSON is
+// parsed once, later loads of the same file contents come from a binary
+// cache named after the contents hash. The cache lives in $VG_CACHE_DIR,
+// or in vlsiproject/ under $XDG_CACHE_HOME (~/.cache by default), created
+// private to the user. VG_CACHE_DIR set but empty disables it.
+struct TechLibrary {
+  VG::TechParams wire;
+  VG::BufferLibrary cells;
+  std::vector<std::string> cellNames;
+
+  // Parses the tech JSON, no cache is read or written
+  static TechLibrary parse(const std::string &filename);
+  // Loads from the cache if it matches the file contents, parses and
+  // refreshes the cache otherwise
+  static TechLibrary load(const std::string &filename);
+
+  // Cache of the library parsed from contents with the given hash. Writing
+  // is best effort, reading returns false for a missing, stale or damaged
+  // cache.
+  void writeCache(const std::string &cacheFile, uint64_t sourceHash) const;
+  bool readCache(const std::string &cacheFile, uint64_t sourceHash);
+};
+
+// 64-bit FNV-1a
+uint64_t hashBytes(const std::string &bytes);
+// Empty when there is no cache directory or caching is disabled
+std::string techCachePath(uint64_t sourceHash);
+
+} // namespace JSONTools
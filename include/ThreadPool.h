@@ -0,0 +1,73 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VG {
+
+// Work-stealing pool: every worker pushes and pops its own tasks LIFO and
+// steals the oldest tasks of the others when it runs dry. Threads outside
+// the pool submit to a shared queue.
+class ThreadPool {
+  struct Queue {
+    std::mutex Lock;
+    std::deque<std::function<void()>> Tasks;
+  };
+  // One queue per worker, the last one for outside submitters
+  std::vector<std::unique_ptr<Queue>> Queues;
+  std::vector<std::thread> Workers;
+  std::atomic<size_t> Queued{0};
+  std::mutex SleepLock;
+  std::condition_variable Wake;
+  bool Stop = false;
+
+  bool tryRun(int Self);
+  void workerLoop(int Self);
+
+public:
+  explicit ThreadPool(unsigned Threads);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return Workers.size(); }
+  // Index of the calling worker thread, -1 for threads outside the pool
+  int currentWorker() const;
+  void submit(std::function<void()> Task);
+  // Run one queued task on the calling thread, false if there was none
+  bool runOne() { return tryRun(currentWorker()); }
+};
+
+// Tasks joined together. wait() runs queued tasks while there are any, so
+// groups may be nested inside pool tasks, then sleeps until the last task
+// of the group is done.
+class TaskGroup {
+  ThreadPool &Pool;
+  std::atomic<size_t> Pending{0};
+  std::mutex DoneLock;
+  std::condition_variable Done;
+  std::mutex ErrorLock;
+  std::exception_ptr Error;
+
+  void join();
+
+public:
+  explicit TaskGroup(ThreadPool &Pool) : Pool(Pool) {}
+  ~TaskGroup() { join(); }
+
+  void run(std::function<void()> Task);
+  // Rethrows the first exception thrown by a task
+  void wait();
+};
+
+} // namespace VG
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,90 @@
+#ifndef VG_TYPES_H
+#define VG_TYPES_H
+
+#include "MemStats.h"
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <vector>
+
+namespace VG {
+// Physical parameters of the elements. C-capacitance. R - resistance.
+struct TechParams {
+  float C;
+  float R;
+  float IntrinsicDel;
+};
+
+// Buffer cells available for insertion, referred to by index
+using BufferLibrary = std::vector<TechParams>;
+
+// For convenience in presenting the solution
+struct BufPlace {
+  int ParentID;
+  int ChildID;
+  int Len;
+  // Library cell of the buffer
+  int Cell = 0;
+
+  bool operator!=(const BufPlace &Rhs) const {
+    return ParentID != Rhs.ParentID || ChildID != Rhs.ChildID ||
+           Len != Rhs.Len || Cell != Rhs.Cell;
+  };
+  bool operator==(const BufPlace &Rhs) const { return !(*this != Rhs); }
+};
+
+// Node of the persistent solution history. Candidates share common prefixes
+// instead of owning a copy of their buffers: a buffer record points to the
+// history it was inserted on top of, a merge record joins two branches.
+struct SolutionRecord {
+  BufPlace Buf;
+  const SolutionRecord *Prev = nullptr;
+  // Second branch, set for merge records only
+  const SolutionRecord *Other = nullptr;
+  bool IsMerge = false;
+};
+
+// Owns all history records of one optimization run. Records are never moved,
+// so candidates may keep raw pointers to them.
+class SolutionArena {
+  std::deque<SolutionRecord, CountingAllocator<SolutionRecord>> Records;
+
+public:
+  const SolutionRecord *addBuffer(const BufPlace &Buf,
+                                  const SolutionRecord *Prev);
+  const SolutionRecord *merge(const SolutionRecord *First,
+                              const SolutionRecord *Second);
+  // Rebuild the full buffer list in insertion order. Histories may span
+  // several arenas.
+  static std::vector<BufPlace> collect(const SolutionRecord *Hist);
+  size_t size() const { return Records.size(); }
+  void clear() { Records.clear(); }
+};
+
+struct Params {
+  float C;
+  float RAT;
+  const SolutionRecord *Hist = nullptr;
+
+  bool operator<(const Params &Rhs) const {
+    if (C < Rhs.C)
+      return true;
+    return RAT < Rhs.RAT;
+  }
+
+  bool operator==(const Params &Rhs) const {
+    return (std::fabs(C - Rhs.C) < std::numeric_limits<float>::epsilon()) &&
+           (std::fabs(RAT - Rhs.RAT) < std::numeric_limits<float>::epsilon());
+  }
+};
+
+// Final answer for the whole net
+struct Solution {
+  float C;
+  float RAT;
+  std::vector<BufPlace> Buffers;
+};
+
+} // namespace VG
+
+#endif // VG_TYPES_H
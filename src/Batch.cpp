@@ -0,0 +1,180 @@
+#include "Batch.h"
+#include "JSONTools.h"
+#include "NetFormat.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <numeric>
+
+namespace Batch {
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> collectNets(const std::string &source,
+                                     const std::string &techFilename) {
+  std::vector<fs::path> candidates;
+  if (fs::is_directory(source)) {
+    for (const auto &entry : fs::directory_iterator(source))
+      if (entry.is_regular_file() && (entry.path().extension() == ".json" ||
+                                      entry.path().extension() == ".vgnet"))
+        candidates.push_back(entry.path());
+    // A net converted to binary is run once, from the binary file
+    std::erase_if(candidates, [](const fs::path &path) {
+      return path.extension() == ".json" &&
+             fs::exists(fs::path(path).replace_extension(".vgnet"));
+    });
+    std::sort(candidates.begin(), candidates.end());
+  } else {
+    std::ifstream manifest(source);
+    if (!manifest.is_open()) {
+      throw std::runtime_error("Could not open batch manifest: " + source);
+    }
+    auto base = fs::path(source).parent_path();
+    std::string line;
+    while (std::getline(manifest, line)) {
+      line = line.substr(0, line.find('#'));
+      auto first = line.find_first_not_of(" \t\r");
+      if (first == std::string::npos)
+        continue;
+      auto last = line.find_last_not_of(" \t\r");
+      fs::path net = line.substr(first, last - first + 1);
+      candidates.push_back(net.is_absolute() ? net : base / net);
+    }
+  }
+
+  std::vector<std::string> nets;
+  // Output files go to the working directory, named after the stem only
+  std::map<std::string, std::string> outputs;
+  for (const auto &path : candidates) {
+    std::error_code ec;
+    if (fs::equivalent(path, techFilename, ec))
+      continue;
+    auto stem = path.stem().string();
+    if (stem.size() > 4 && stem.compare(stem.size() - 4, 4, "_out") == 0)
+      continue;
+    auto output = JSONTools::outputFilename(path.string());
+    auto [other, added] = outputs.emplace(output, path.string());
+    if (!added)
+      throw std::runtime_error(other->second + " and " + path.string() +
+                               " would both write " + output);
+    nets.push_back(path.string());
+  }
+  return nets;
+}
+
+NetResult optimizeNet(const std::string &testFilename,
+                      VG::NetOptimizer &optimizer,
+                      const std::vector<std::string> &cellNames,
+                      bool compact) {
+  using namespace std::chrono;
+  NetResult result;
+  result.file = testFilename;
+  auto start = steady_clock::now();
+  try {
+    if (NetFormat::isBinaryNet(testFilename)) {
+      NetFormat::NetFile net(testFilename);
+      auto buffered =
+          optimizer.optimize(net.view(), net.driverCell(cellNames));
+      NetFormat::writeOutputFile(testFilename, net, buffered, false,
+                                 cellNames, compact);
+      result.ok = true;
+      result.rat = buffered.RAT;
+      result.buffers = buffered.Buffers.size();
+    } else {
+      auto inputData = JSONTools::parseTestFile(testFilename);
+      auto &engine = optimizer.engine();
+
+      std::vector<VG::Edge> edges;
+      std::vector<VG::Node> nodes;
+      std::map<int, int> originalToNewId, newToOriginalId;
+      JSONTools::convertToVGStructures(inputData, edges, nodes, originalToNewId,
+                                       newToOriginalId);
+
+      engine.setDriverCell(JSONTools::findDriverCell(inputData, cellNames));
+      engine.buildRoutingTree(edges, nodes);
+      auto optimalParams = engine.getOptimParams();
+
+      JSONTools::writeOutputFile(testFilename, inputData, optimalParams.Buffers,
+                                 newToOriginalId, false, cellNames, compact);
+      result.ok = true;
+      result.rat = optimalParams.RAT;
+      // The driver itself is reported as a buffer on the root
+      result.buffers = std::count_if(
+          optimalParams.Buffers.begin(), optimalParams.Buffers.end(),
+          [](const auto &buf) {
+            return buf.ParentID != 0 || buf.ChildID != 0;
+          });
+    }
+  } catch (const std::exception &e) {
+    result.error = e.what();
+  }
+  result.millis =
+      duration<double, std::milli>(steady_clock::now() - start).count();
+  return result;
+}
+
+std::vector<NetResult> run(const std::vector<std::string> &nets,
+                           const VG::TechParams &wireParams,
+                           const VG::BufferLibrary &library,
+                           const std::vector<std::string> &cellNames,
+                           const VG::Options &options, bool compact) {
+  // Largest nets first, so a big one does not start last and keep a single
+  // thread busy at the end
+  std::vector<uint64_t> sizes(nets.size());
+  for (size_t i = 0; i < nets.size(); ++i) {
+    std::error_code ec;
+    auto size = fs::file_size(nets[i], ec);
+    sizes[i] = ec ? 0 : size;
+  }
+  std::vector<size_t> order(nets.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  // Nets are the unit of parallelism, every net itself runs serially
+  VG::Options netOptions = options;
+  netOptions.Threads = 1;
+  std::vector<NetResult> results(nets.size());
+  VG::ThreadPool pool(std::max(1u, options.Threads) - 1);
+  // Engines keep their memory from net to net, each thread reuses its own
+  std::vector<std::unique_ptr<VG::NetOptimizer>> optimizers(pool.size() + 1);
+  VG::TaskGroup group(pool);
+  for (auto idx : order)
+    group.run([&, idx] {
+      auto &optimizer = optimizers[pool.currentWorker() + 1];
+      if (!optimizer)
+        optimizer = std::make_unique<VG::NetOptimizer>(wireParams, library,
+                                                       netOptions);
+      results[idx] = optimizeNet(nets[idx], *optimizer, cellNames, compact);
+    });
+  group.wait();
+  return results;
+}
+
+// Quoted CSV field, quotes inside doubled
+static std::string quoted(const std::string &field) {
+  std::string out = "\"";
+  for (char c : field) {
+    if (c == '"')
+      out += '"';
+    out += c;
+  }
+  return out + '"';
+}
+
+void writeSummary(std::ostream &out, const std::vector<NetResult> &results) {
+  out << "net,status,rat,buffers,ms\n";
+  for (const auto &result : results) {
+    out << quoted(result.file) << ',';
+    if (result.ok)
+      out << "ok," << result.rat << ',' << result.buffers;
+    else
+      out << quoted("error: " + result.error) << ",,";
+    out << ',' << result.millis << '\n';
+  }
+}
+
+} // namespace Batch
@@ -37,10 +37,174 @@ static void printNTree(Node *N, int nv) {
 }
 #endif
 
-void BufferInsertVG::buildRoutingTree(std::vector<Edge> &Edges,
-                                   std::vector<Node> &Sinks) {
-  CountSinks = Sinks.size();
-  buildRecursive(Root, Edges, Sinks);
+const SolutionRecord *SolutionArena::addBuffer(const BufPlace &Buf,
+                                               const SolutionRecord *Prev) {
+  return &Records.emplace_back(SolutionRecord{Buf, Prev, nullptr, false});
+}
+
+const SolutionRecord *SolutionArena::merge(const SolutionRecord *First,
+                                           const SolutionRecord *Second) {
+  // Branch without buffers adds nothing to the history
+  if (!Second)
+    return First;
+  if (!First)
+    return Second;
+  return &Records.emplace_back(SolutionRecord{{}, First, Second, true});
+}
+
+std::vector<BufPlace> SolutionArena::collect(const SolutionRecord *Hist) {
+  // Walk the history backwards (latest buffer first) with an explicit stack,
+  // long nets produce chains too deep for recursion
+  std::vector<BufPlace> Result;
+  std::vector<const SolutionRecord *> Stack{Hist};
+  while (!Stack.empty()) {
+    auto *Rec = Stack.back();
+    Stack.pop_back();
+    if (!Rec)
+      continue;
+    if (Rec->IsMerge) {
+      Stack.push_back(Rec->Prev);
+      Stack.push_back(Rec->Other);
+    } else {
+      Result.push_back(Rec->Buf);
+      Stack.push_back(Rec->Prev);
+    }
+  }
+  std::reverse(Result.begin(), Result.end());
+  return Result;
+}
+
+Node *NodeArena::create(int ID) {
+  if (Used == Blocks.size() * BlockSize)
+    Blocks.emplace_back(BlockSize);
+  Node *N = &Blocks[Used / BlockSize][Used % BlockSize];
+  ++Used;
+  N->ID = ID;
+  return N;
+}
+
+void NodeArena::reset() {
+  PeakBytes = peakBytes();
+  for (size_t I = 0; I < Used; ++I) {
+    Node &N = Blocks[I / BlockSize][I % BlockSize];
+    N.Children.clear();
+    N.Lens.clear();
+    N.CapsRATs.clear();
+  }
+  Used = 0;
+}
+
+size_t NodeArena::bytes() const {
+  size_t Bytes = Blocks.size() * BlockSize * sizeof(Node);
+  for (const auto &Block : Blocks)
+    for (size_t I = 0; I < BlockSize; ++I)
+      Bytes += Block[I].Children.capacity() * sizeof(Node *) +
+               Block[I].Lens.capacity() * sizeof(int) +
+               Block[I].CapsRATs.capacityBytes();
+  return Bytes;
+}
+
+void BufferInsertVG::reset() {
+  Nodes.reset();
+  Root = Nodes.create(0);
+  CountSinks = 0;
+  CountIDs = 1;
+  Visits.clear();
+  VisitPos.clear();
+  Solved.clear();
+  Sites.clear();
+  for (auto &Arena : Arenas)
+    Arena.clear();
+  LiveRecords = 0;
+}
+
+void BufferInsertVG::setDriverCell(int Cell) {
+  if (Cell < 0 || Cell >= int(Library.size()))
+    throw std::runtime_error("Driver cell is not in the buffer library");
+  Opts.DriverCell = Cell;
+}
+
+void BufferInsertVG::buildRoutingTree(std::span<const Edge> Edges,
+                                      std::span<const Node> Sinks) {
+  buildTree(Edges, Sinks.size(), [&](Node *N) {
+    N->CapsRATs = Sinks[N->ID - 1].CapsRATs;
+  });
+}
+
+void BufferInsertVG::buildRoutingTree(std::span<const Edge> Edges,
+                                      std::span<const Params> Sinks) {
+  buildTree(Edges, Sinks.size(),
+            [&](Node *N) { N->CapsRATs.push_back(Sinks[N->ID - 1]); });
+}
+
+template <class SinkInit>
+void BufferInsertVG::buildTree(std::span<const Edge> Edges, size_t Sinks,
+                               SinkInit InitSink) {
+  MemPhaseScope Phase(MemPhase::Build);
+  reset();
+  CountSinks = Sinks;
+  for (const auto &Eg : Edges) {
+    if (Eg.Start < 0 || Eg.End < 0)
+      throw std::runtime_error("Negative node ID in the routing tree");
+    CountIDs = std::max(CountIDs, std::max(Eg.Start, Eg.End) + 1);
+    if (Eg.Pitch < 0)
+      throw std::runtime_error("Negative buffer site pitch on the wire to " +
+                               std::to_string(Eg.End));
+  }
+  Sites.assign(CountIDs, {Opts.SitePitch, {}});
+  for (const auto &Eg : Edges) {
+    auto &Rule = Sites[Eg.End];
+    if (Eg.Pitch)
+      Rule.Pitch = Eg.Pitch;
+    Rule.Blocked = Eg.Blocked;
+    std::sort(Rule.Blocked.begin(), Rule.Blocked.end());
+    // Overlapping or touching ranges become one
+    size_t Kept = 0;
+    for (size_t I = 1; I < Rule.Blocked.size(); ++I) {
+      auto &Last = Rule.Blocked[Kept];
+      if (Rule.Blocked[I].first <= Last.second + 1)
+        Last.second = std::max(Last.second, Rule.Blocked[I].second);
+      else
+        Rule.Blocked[++Kept] = Rule.Blocked[I];
+    }
+    if (!Rule.Blocked.empty())
+      Rule.Blocked.resize(Kept + 1);
+  }
+
+  // Outgoing edges of every node in CSR form, edges of a node keep their
+  // input order so children are numbered as before
+  std::vector<int> First(CountIDs + 1, 0);
+  for (const auto &Eg : Edges)
+    ++First[Eg.Start + 1];
+  for (int ID = 0; ID < CountIDs; ++ID)
+    First[ID + 1] += First[ID];
+  std::vector<int> Adjacent(Edges.size());
+  auto Fill = First;
+  for (size_t I = 0; I < Edges.size(); ++I)
+    Adjacent[Fill[Edges[I].Start]++] = I;
+
+  std::vector<char> Seen(CountIDs, false);
+  std::vector<Node *> Stack{Root};
+  Seen[Root->ID] = true;
+  while (!Stack.empty()) {
+    Node *N = Stack.back();
+    Stack.pop_back();
+    if (N->ID > 0 && N->ID < CountSinks + 1) {
+      // sink
+      InitSink(N);
+    }
+    for (int K = First[N->ID]; K < First[N->ID + 1]; ++K) {
+      const auto &Eg = Edges[Adjacent[K]];
+      if (Seen[Eg.End])
+        throw std::runtime_error("Routing tree has a cycle at node " +
+                                 std::to_string(Eg.End));
+      Seen[Eg.End] = true;
+      Node *New = Nodes.create(Eg.End);
+      N->Children.push_back(New);
+      N->Lens.push_back(Eg.Len);
+      Stack.push_back(New);
+    }
+  }
 
 #ifdef DEBUG
   std::cout << "Result tree:\n";
@@ -53,194 +217,605 @@ void BufferInsertVG::buildRoutingTree(std::vector<Edge> &Edges,
 #endif
 }
 
-Params BufferInsertVG::getOptimParams() {
-  Root->CapsRATs = recursiveVanGin(Root);
-  insertBuffer(Root->CapsRATs, Root, Root, 0);
-  auto NoContainMainBuf = [](const auto &CR) {
-    if (CR.Buffers.empty())
-      return true;
-    return CR.Buffers.back() != BufPlace{0, 0, 0};
+BufferInsertVG::BufferInsertVG(const TechParams &UnitWire,
+                               const BufferLibrary &Library,
+                               const Options &Opts)
+    : UnitWire(UnitWire), Library(Library), Opts(Opts), Arenas(1) {
+  if (Library.empty())
+    throw std::runtime_error("Buffer library is empty");
+  if (Opts.SitePitch < 1)
+    throw std::runtime_error("Buffer site pitch must be positive");
+  if (!(Opts.Epsilon >= 0 && Opts.Epsilon < 1))
+    throw std::runtime_error("Pruning tolerance must be in [0, 1)");
+  setDriverCell(Opts.DriverCell);
+  MemPhaseScope Phase(MemPhase::Build);
+  Root = Nodes.create(0);
+  if (Opts.Threads > 1) {
+    Pool = std::make_unique<ThreadPool>(Opts.Threads - 1);
+    Arenas.resize(Opts.Threads);
+  }
+  Pruning.resize(Arenas.size());
+  if (Opts.Profile)
+    Profile = std::make_unique<DPProfile>();
+
+  SiteCells = usefulCells(Library);
+
+  // A stage of length l driving the next buffer takes
+  //   D + R (c l + C) + r l C + r c l^2 / 2,
+  // per unit length that is the least at l^2 = 2 (D + R C) / (r c)
+  if (Opts.FastWires && fastWires(UnitWire, Library)) {
+    const auto &B = Library[SiteCells.front()];
+    auto Best = std::sqrt(2 * (B.IntrinsicDel + B.R * B.C) /
+                          (UnitWire.R * UnitWire.C));
+    Spacing = std::max(1L, std::lround(Best));
+  }
+}
+
+std::vector<int> BufferInsertVG::usefulCells(const BufferLibrary &Library) {
+  // A cell no better than another one in every parameter never gives a
+  // better solution, identical cells keep the first one
+  auto NoBetter = [&](int Cell, int Other) {
+    const auto &A = Library[Cell];
+    const auto &B = Library[Other];
+    bool Same = A.C == B.C && A.R == B.R && A.IntrinsicDel == B.IntrinsicDel;
+    return B.C <= A.C && B.R <= A.R && B.IntrinsicDel <= A.IntrinsicDel &&
+           (!Same || Other < Cell);
   };
-  Root->CapsRATs.remove_if(NoContainMainBuf);
-  pruneSolutions(Root->CapsRATs);
-#ifdef DEBUG
+  std::vector<int> Cells;
+  for (int Cell = 0; Cell < int(Library.size()); ++Cell) {
+    bool Dominated = false;
+    for (int Other = 0; !Dominated && Other < int(Library.size()); ++Other)
+      Dominated = Other != Cell && NoBetter(Cell, Other);
+    if (!Dominated)
+      Cells.push_back(Cell);
+  }
+  std::stable_sort(Cells.begin(), Cells.end(), [&](int A, int B) {
+    return Library[A].C < Library[B].C;
+  });
+  return Cells;
+}
 
-  std::cout << "Optim RAT: " << Root->CapsRATs.back().RAT
-            << ", Count buffers: " << Root->CapsRATs.back().Buffers.size()
-            << "\n";
-  for (auto B : Root->CapsRATs.back().Buffers)
-    std::cout << "    BUFFER Parent: " << B.ParentID
-              << ", Child : " << B.ChildID << ", Len: " << B.Len << "\n";
+bool BufferInsertVG::fastWires(const TechParams &UnitWire,
+                               const BufferLibrary &Library) {
+  return usefulCells(Library).size() == 1 && UnitWire.R > 0 && UnitWire.C > 0;
+}
 
-#endif
-  assert(Root->CapsRATs.size() == 1);
-  return Root->CapsRATs.back();
+SolutionArena &BufferInsertVG::history() {
+  return Arenas[Pool ? Pool->currentWorker() + 1 : 0];
 }
 
-static bool isAllVisited(std::vector<Edge> &Edges) {
-  return std::all_of(Edges.begin(), Edges.end(),
-                     [](const auto Eg) { return Eg.IsVisited; });
+// Children come before their parent and every subtree occupies a contiguous
+// range ending at its root
+std::vector<BufferInsertVG::Visit> BufferInsertVG::postOrder() const {
+  std::vector<Visit> Order;
+  std::vector<std::pair<Visit, bool>> Stack{{{Root, nullptr, 0}, false}};
+  while (!Stack.empty()) {
+    auto &[V, Expanded] = Stack.back();
+    if (Expanded) {
+      Order.push_back(V);
+      Stack.pop_back();
+      continue;
+    }
+    Expanded = true;
+    Node *N = V.N;
+    for (size_t I = N->Children.size(); I-- > 0;)
+      Stack.push_back({{N->Children[I], N, I}, false});
+  }
+  return Order;
 }
 
-void BufferInsertVG::buildRecursive(Node *N, std::vector<Edge> &Edges,
-                                    std::vector<Node> &Sinks) const {
-  if (N->ID > 0 && N->ID < CountSinks + 1) {
-    // sink
-    N->CapsRATs = Sinks[N->ID - 1].CapsRATs;
+Solution BufferInsertVG::getOptimParams() {
+  MemPhaseScope Phase(MemPhase::DP);
+  if (Profile)
+    Profile->start(CountIDs);
+  std::fill(Pruning.begin(), Pruning.end(), PruneStats{});
+  // Every list is solved again, nothing refers to the earlier history
+  for (auto &Arena : Arenas)
+    Arena.clear();
+  Visits = postOrder();
+  VisitPos.assign(CountIDs, 0);
+  for (size_t P = 0; P < Visits.size(); ++P)
+    VisitPos[Visits[P].N->ID] = P;
+  Solved.clear();
+  Solved.resize(CountIDs);
+  if (Pool) {
+    solveParallel(Visits, Solved);
+  } else {
+    for (const auto &V : Visits)
+      solveNode(V, Solved);
   }
-  if (!isAllVisited(Edges)) {
-    for (auto &Eg : Edges) {
-      if (N->ID == Eg.Start) {
-        Eg.IsVisited = true;
-        Node *New = new Node;
-        New->ID = Eg.End;
-        N->Children.push_back(New);
-        N->Lens.push_back(Eg.Len);
-        buildRecursive(N->Children.back(), Edges, Sinks);
-      }
+  LiveRecords = historyRecords();
+  return solveDriver();
+}
+
+Solution BufferInsertVG::update(const Delta &Changes) {
+  MemPhaseScope Phase(MemPhase::DP);
+  if (!Opts.Incremental || Solved.empty())
+    throw std::runtime_error("Update needs a previous incremental run");
+  if (Profile)
+    Profile->start(CountIDs);
+  std::fill(Pruning.begin(), Pruning.end(), PruneStats{});
+
+  auto VisitOf = [&](int ID) -> const Visit & {
+    if (ID < 0 || ID >= CountIDs || Visits[VisitPos[ID]].N->ID != ID)
+      throw std::runtime_error("Node " + std::to_string(ID) +
+                               " is not in the routing tree");
+    return Visits[VisitPos[ID]];
+  };
+  std::vector<char> Dirty(Visits.size(), false);
+  // The changed node and its ancestors, up to the first one already dirty
+  auto Invalidate = [&](int ID) {
+    for (auto P = VisitPos[ID]; !Dirty[P];) {
+      Dirty[P] = true;
+      if (!Visits[P].Parent)
+        break;
+      P = VisitPos[Visits[P].Parent->ID];
     }
+  };
+  for (const auto &Change : Changes.Sinks) {
+    if (Change.ID < 1 || Change.ID > CountSinks)
+      throw std::runtime_error("Node " + std::to_string(Change.ID) +
+                               " is not a sink");
+    VisitOf(Change.ID).N->CapsRATs = {Change.CRAT};
+    Invalidate(Change.ID);
   }
-  return;
+  for (const auto &Change : Changes.Edges) {
+    const auto &V = VisitOf(Change.ID);
+    if (!V.Parent || Change.Len < 0)
+      throw std::runtime_error("Bad wire change at node " +
+                               std::to_string(Change.ID));
+    V.Parent->Lens[V.Idx] = Change.Len;
+    Invalidate(Change.ID);
+  }
+
+  // Post order, so children are done before their parents
+  for (size_t P = 0; P < Visits.size(); ++P)
+    if (Dirty[P])
+      solveNode(Visits[P], Solved);
+  // Replaced lists leave their records behind, a long series of updates
+  // would keep them all
+  if (historyRecords() > 2 * LiveRecords)
+    compactHistory();
+  return solveDriver();
 }
 
-void BufferInsertVG::addWire(std::list<Params> &List, Node *Parent, Node *Child,
-                          int Len) {
-  assert(!List.empty());
-  constexpr auto UnitLen = 1;
-  std::list<Params> tmpList = List;
-  for (auto &Point : tmpList) {
-    List.remove(Point);
-    Point.RAT = Point.RAT - UnitLen * UnitLen * UnitWire.R * UnitWire.C / 2 -
-                UnitLen * UnitWire.R * Point.C;
-    Point.C = Point.C + UnitLen * UnitWire.C;
-    List.push_back(Point);
-  }
-  return;
+size_t BufferInsertVG::historyRecords() const {
+  size_t Records = 0;
+  for (const auto &Arena : Arenas)
+    Records += Arena.size();
+  return Records;
 }
 
-void BufferInsertVG::insertBuffer(std::list<Params> &List, Node *Parent,
-                                  Node *Child, int Len) {
-  assert(!List.empty());
-  std::list<Params> tmpList = List;
-  for (auto &Point : tmpList) {
-    Point.RAT = Point.RAT - Buffer.R * Point.C - Buffer.IntrinsicDel;
-    Point.C = Buffer.C;
-    Point.Buffers.push_back({Parent->ID, Child->ID, Len});
-    List.push_back(Point);
-  }
-  return;
-}
-
-void BufferInsertVG::pruneSolutions(std::list<Params> &Solutions) {
-  // Sort according to cap values
-  Solutions.sort([](const auto &A, const auto &B) { return A.C < B.C; });
-
-  auto FirstBr = Solutions.begin();
-  auto SecondBr = Solutions.begin();
-  SecondBr++;
-  // We don't need to check for c1 > c2 case as we already sorted the Solutions
-  while (SecondBr != Solutions.end()) {
-    if (FirstBr->C < SecondBr->C) {
-      // Delete element with smaller q
-      if ((FirstBr->RAT) >= (SecondBr->RAT))
-        SecondBr = Solutions.erase(SecondBr);
-      else
-        ++FirstBr, ++SecondBr;
-    } else if (FirstBr->C == SecondBr->C) {
-      // Check for q if c is equal
-      // Delete element with smaller q
-      if (FirstBr->RAT >= SecondBr->RAT)
-        SecondBr = Solutions.erase(SecondBr);
-      else {
-        // Delete one of two equal elements
-        FirstBr = Solutions.erase(FirstBr);
-        ++SecondBr;
+// Copies the records the solved lists still reach into a fresh arena, each
+// once and after the records it points to, and drops all others
+void BufferInsertVG::compactHistory() {
+  SolutionArena Live;
+  std::unordered_map<const SolutionRecord *, const SolutionRecord *> Moved{
+      {nullptr, nullptr}};
+  std::vector<const SolutionRecord *> Stack;
+  auto Move = [&](const SolutionRecord *Hist) {
+    Stack.push_back(Hist);
+    while (!Stack.empty()) {
+      const auto *Record = Stack.back();
+      if (Moved.count(Record)) {
+        Stack.pop_back();
+        continue;
+      }
+      auto Prev = Moved.find(Record->Prev);
+      auto Other = Moved.find(Record->Other);
+      if (Prev == Moved.end()) {
+        Stack.push_back(Record->Prev);
+      } else if (Other == Moved.end()) {
+        Stack.push_back(Record->Other);
+      } else {
+        Moved.emplace(Record,
+                      Record->IsMerge
+                          ? Live.merge(Prev->second, Other->second)
+                          : Live.addBuffer(Record->Buf, Prev->second));
+        Stack.pop_back();
       }
     }
+    return Moved.at(Hist);
+  };
+  for (auto &List : Solved)
+    List.moveHistories(Move);
+  for (auto &Arena : Arenas)
+    Arena.clear();
+  Arenas.front() = std::move(Live);
+  LiveRecords = historyRecords();
+}
+
+// Driver buffer at the root: the best solution it can drive
+Solution BufferInsertVG::solveDriver() {
+  if (Opts.Incremental)
+    Root->CapsRATs = Solved[Root->ID];
+  else
+    Root->CapsRATs = std::move(Solved[Root->ID]);
+  auto Best = Root->CapsRATs.insertBuffer(
+      Library[Opts.DriverCell], {0, 0, 0, Opts.DriverCell}, history());
+
+  RATBound = Root->CapsRATs.slack();
+  Solution Result{Best.C, Best.RAT, SolutionArena::collect(Best.Hist)};
+#ifdef DEBUG
+
+  size_t Records = historyRecords();
+  std::cout << "Optim RAT: " << Result.RAT
+            << ", Count buffers: " << Result.Buffers.size()
+            << ", History records: " << Records << "\n";
+  for (auto B : Result.Buffers)
+    std::cout << "    BUFFER Parent: " << B.ParentID
+              << ", Child : " << B.ChildID << ", Len: " << B.Len
+              << ", Cell: " << B.Cell << "\n";
+
+#endif
+  return Result;
+}
+
+// Candidates added and dropped by an operation that started from Size
+// candidates, Dropped of them dropped before
+static void countChange(NodeProfile &Stats, const CandidateList &List,
+                        size_t Size, size_t Dropped) {
+  auto NewlyDropped = List.dropped() - Dropped;
+  Stats.Created += List.size() + NewlyDropped - Size;
+  Stats.Pruned += NewlyDropped;
+  Stats.PeakLength = std::max(Stats.PeakLength, List.size());
+}
+
+void BufferInsertVG::addWire(CandidateList &List, Node *Child, int Len) {
+  assert(!List.empty());
+  PhaseTimer Timer(Profile.get(), profiled(Child->ID), Phase::Wire);
+  List.addWire(UnitWire, Len);
+}
+
+void BufferInsertVG::insertBuffer(CandidateList &List, Node *Parent,
+                                  Node *Child, int Len) {
+  auto *Stats = profiled(Child->ID);
+  PhaseTimer Timer(Profile.get(), Stats, Phase::Buffer);
+  auto Size = List.size();
+  auto Dropped = List.dropped();
+  List.insertBuffers(Library, SiteCells, {Parent->ID, Child->ID, Len},
+                     history());
+  if (Stats)
+    countChange(*Stats, List, Size, Dropped);
+  if (Opts.CheckInvariants)
+    checkOrder(List, false, Child, "buffer insertion");
+}
+
+void BufferInsertVG::prune(CandidateList &List, Node *N) {
+  auto *Stats = profiled(N->ID);
+  PhaseTimer Timer(Profile.get(), Stats, Phase::Prune);
+  auto Size = List.size();
+  auto Dropped = List.dropped();
+  auto Thinned = List.prune(Opts.Epsilon);
+  if (Stats)
+    countChange(*Stats, List, Size, Dropped);
+  if (Opts.CheckInvariants)
+    checkOrder(List, true, N, "prune");
+  if (Opts.Epsilon > 0) {
+    auto &Counts = pruning();
+    ++Counts.Prunes;
+    Counts.Thinned += Thinned;
+    Counts.LongestList = std::max(Counts.LongestList, List.size());
+    Counts.TotalLength += List.size();
   }
 }
 
-std::list<Params> BufferInsertVG::mergeBranch(std::list<Params> &First,
-                                              std::list<Params> &Second,
-                                              Node *Parent) {
-  std::list<Params> Result;
-  for (auto &FirstBr : First) {
-    for (auto &SecondBr : Second) {
+PruneStats BufferInsertVG::pruneStats() const {
+  PruneStats Total;
+  Total.Epsilon = Opts.Epsilon;
+  Total.RATBound = RATBound;
+  for (const auto &Counts : Pruning) {
+    Total.Prunes += Counts.Prunes;
+    Total.Thinned += Counts.Thinned;
+    Total.LongestList = std::max(Total.LongestList, Counts.LongestList);
+    Total.TotalLength += Counts.TotalLength;
+    Total.ParallelMerges += Counts.ParallelMerges;
+    Total.StolenMerges += Counts.StolenMerges;
+  }
+  return Total;
+}
+
+void BufferInsertVG::checkOrder(const CandidateList &List, bool Pruned,
+                                Node *N, const char *Step) const {
+  if (Pruned ? !List.pruned() : !List.ordered())
+    throw std::runtime_error(std::string("Candidates of node ") +
+                             std::to_string(N->ID) + " lost their order after " +
+                             Step);
+}
+
+// Both branches are pruned: sorted by caps with strictly growing RATs. The
+// RAT of a pair is limited by the branch with the smaller RAT, so that branch
+// is advanced, which gives at most |First| + |Second| candidates.
+CandidateList BufferInsertVG::mergeBranch(CandidateList &First,
+                                          CandidateList &Second,
+                                          Node *Parent) {
+  MemPhaseScope MemPhase(MemPhase::Merge);
+  auto *Stats = profiled(Parent->ID);
+  PhaseTimer Timer(Profile.get(), Stats, Phase::Merge);
+  CandidateList Result;
+  size_t FirstIdx = 0;
+  size_t SecondIdx = 0;
+  while (FirstIdx < First.size() && SecondIdx < Second.size()) {
+    auto FirstBr = First.at(FirstIdx);
+    auto SecondBr = Second.at(SecondIdx);
+    auto NewC = FirstBr.C + SecondBr.C;
+    auto NewRAT = std::min(FirstBr.RAT, SecondBr.RAT);
+    auto *Hist = history().merge(FirstBr.Hist, SecondBr.Hist);
+    Result.push_back(Params{NewC, NewRAT, Hist});
+
+    if (FirstBr.RAT < SecondBr.RAT)
+      ++FirstIdx;
+    else if (SecondBr.RAT < FirstBr.RAT)
+      ++SecondIdx;
+    else
+      ++FirstIdx, ++SecondIdx;
+  }
+  Result.raiseSlack(std::max(First.slack(), Second.slack()));
+
+  if (Opts.CheckedMerge)
+    checkMerge(First, Second, Result);
+  if (Opts.CheckInvariants)
+    checkOrder(Result, false, Parent, "merge");
+  if (Stats)
+    countChange(*Stats, Result, 0, 0);
+  return Result;
+}
+
+// Reference merge: every pair of candidates
+CandidateList BufferInsertVG::mergeCrossProduct(CandidateList &First,
+                                                CandidateList &Second) {
+  CandidateList Result;
+  for (size_t FirstIdx = 0; FirstIdx < First.size(); ++FirstIdx) {
+    for (size_t SecondIdx = 0; SecondIdx < Second.size(); ++SecondIdx) {
+      auto FirstBr = First.at(FirstIdx);
+      auto SecondBr = Second.at(SecondIdx);
       auto NewC = FirstBr.C + SecondBr.C;
-      // It is works because both branches already sorted by caps
       auto NewRAT = std::min(FirstBr.RAT, SecondBr.RAT);
-      std::vector<BufPlace> Bufs;
-      std::copy(FirstBr.Buffers.begin(), FirstBr.Buffers.end(),
-                std::back_inserter(Bufs));
-      std::copy(SecondBr.Buffers.begin(), SecondBr.Buffers.end(),
-                std::back_inserter(Bufs));
+      auto *Hist = history().merge(FirstBr.Hist, SecondBr.Hist);
 
-      Result.push_back(Params{NewC, NewRAT, std::move(Bufs)});
+      Result.push_back(Params{NewC, NewRAT, Hist});
     }
   }
   return Result;
 }
 
-[[maybe_unused]] static void printSolutions(std::list<Params> &List) {
+void BufferInsertVG::checkMerge(CandidateList &First, CandidateList &Second,
+                                const CandidateList &Merged) {
+  auto Reference = mergeCrossProduct(First, Second);
+  Reference.prune();
+  auto Linear = Merged;
+  Linear.prune();
+  bool Same = Linear.size() == Reference.size();
+  for (size_t I = 0; Same && I < Linear.size(); ++I)
+    Same = Linear.at(I) == Reference.at(I);
+  if (!Same)
+    throw std::runtime_error("Linear merge differs from the cross product: " +
+                             std::to_string(Linear.size()) + " vs " +
+                             std::to_string(Reference.size()) + " solutions");
+}
+
+[[maybe_unused]] static void printSolutions(const CandidateList &List) {
   std::cout << "\nList:\n";
-  for (auto El : List)
+  for (size_t I = 0; I < List.size(); ++I) {
+    auto El = List.at(I);
     std::cout << " {c= " << El.C << ", rat= " << El.RAT
-              << ", buffs=" << El.Buffers.size() << "\n";
+              << ", hist=" << El.Hist << "\n";
+  }
   std::cout << "\n";
 }
 
-std::list<Params>
-BufferInsertVG::mergeBranches(std::vector<std::list<Params>> &CldParams,
+// Lists are merged in rounds of a balanced merge tree: every round sorts
+// the lists by size and merges neighbours, so a short list is never merged
+// into a long one early and the long intermediate lists come in the last
+// rounds. The longest list of an odd round waits for the next one. Unlike
+// Huffman order, the largest pair of a round merges together with the
+// smallest; that keeps the pairs of a round independent, so a large round
+// runs on the pool. The order depends on the list sizes and the child order
+// only, never on the schedule.
+CandidateList
+BufferInsertVG::mergeBranches(CountedVector<CandidateList> &CldParams,
                               Node *Parent) {
-  if (CldParams.size() == 1)
-    return CldParams.back();
+  std::vector<size_t> Order;
+  CountedVector<CandidateList> Merged;
+  while (CldParams.size() > 1) {
+    auto Lists = CldParams.size();
+    Order.resize(Lists);
+    size_t Candidates = 0;
+    for (size_t I = 0; I < Lists; ++I) {
+      Order[I] = I;
+      Candidates += CldParams[I].size();
+    }
+    std::stable_sort(Order.begin(), Order.end(), [&](size_t A, size_t B) {
+      return CldParams[A].size() < CldParams[B].size();
+    });
 
-  std::list<Params> FirstBr = *CldParams.begin();
-  for (auto SecondBr = std::next(CldParams.begin());
-       SecondBr != CldParams.end(); ++SecondBr) {
-    FirstBr = mergeBranch(FirstBr, *SecondBr, Parent);
-    pruneSolutions(FirstBr);
+    auto Pairs = Lists / 2;
+    Merged.clear();
+    Merged.resize(Pairs);
+    auto Merge = [&](size_t K) {
+      auto &First = CldParams[Order[2 * K]];
+      auto &Second = CldParams[Order[2 * K + 1]];
+      Merged[K] = mergeBranch(First, Second, Parent);
+      prune(Merged[K], Parent);
+      First = {};
+      Second = {};
+    };
+    // Profiled statistics of the node are not shared between threads
+    if (Pool && !Profile && Pairs > 1 && Candidates >= MergeCutoff) {
+      ++pruning().ParallelMerges;
+      int Caller = Pool->currentWorker();
+      TaskGroup Group(*Pool);
+      for (size_t K = 1; K < Pairs; ++K)
+        Group.run([&, K] {
+          Merge(K);
+          if (Pool->currentWorker() != Caller)
+            ++pruning().StolenMerges;
+        });
+      Merge(0);
+      Group.wait();
+    } else {
+      for (size_t K = 0; K < Pairs; ++K)
+        Merge(K);
+    }
+    // The longest list waits for the next round
+    if (Lists % 2)
+      Merged.push_back(std::move(CldParams[Order.back()]));
+    CldParams.swap(Merged);
   }
 
-  return FirstBr;
+  return std::move(CldParams.front());
+}
+
+int BufferInsertVG::nextSite(const SiteRule &Rule, int From,
+                             int Last) const {
+  auto Site = (From + Rule.Pitch - 1) / Rule.Pitch * Rule.Pitch;
+  auto Range = std::lower_bound(
+      Rule.Blocked.begin(), Rule.Blocked.end(), Site,
+      [](const std::pair<int, int> &R, int Site) { return R.second < Site; });
+  for (; Range != Rule.Blocked.end() && Range->first <= Site; ++Range)
+    Site = std::max(Site,
+                    (Range->second + Rule.Pitch) / Rule.Pitch * Rule.Pitch);
+  return Site <= Last ? Site : -1;
+}
+
+int BufferInsertVG::fastSite(int From, int Last) const {
+  int Window = 2 * Spacing;
+  int Middle = Last - 2 * Window;
+  if (From <= Window || From >= Last - Window)
+    return From <= Last ? From : -1;
+  long Stages = std::max(1L, std::lround(double(Middle) / Spacing));
+  auto Site = [&](long K) {
+    return Window + int((K * Middle + Stages / 2) / Stages);
+  };
+  auto K = long(From - Window) * Stages / Middle;
+  while (Site(K) < From)
+    ++K;
+  return Site(K);
+}
+
+// Extends solutions of the subtree at V.N by the wire to its parent, with
+// buffers tried at the legal sites along that wire. The wire between two
+// sites is one lazy step, so the work follows the number of sites.
+void BufferInsertVG::extendToParent(CandidateList &List, const Visit &V) {
+  Node *Parent = V.Parent;
+  Node *Cld = V.N;
+  auto LenCld = Parent->Lens[V.Idx];
+  const auto &Rule = Sites[Cld->ID];
+
+  if (LenCld == 0) {
+    if (nextSite(Rule, 0, 0) == 0)
+      insertBuffer(List, Parent, Cld, 0);
+  } else {
+    // A buffer at site j of a sink wire follows j units of wire, one unit
+    // more on the wire of a Steiner point
+    int Shift = Cld->ID < CountSinks + 1 ? 0 : 1;
+    bool Fast = Spacing && LenCld > 8 * Spacing && Rule.Pitch == 1 &&
+                Rule.Blocked.empty();
+    auto Next = [&](int From) {
+      return Fast ? fastSite(From, LenCld - Shift)
+                  : nextSite(Rule, From, LenCld - Shift);
+    };
+    int Done = 0;
+    for (auto j = Next(1 - Shift); j >= 0; j = Next(j + 1)) {
+      addWire(List, Cld, j + Shift - Done);
+      Done = j + Shift;
+      insertBuffer(List, Parent, Cld, j);
+    }
+    if (Done < LenCld)
+      addWire(List, Cld, LenCld - Done);
+  }
+  // Dominated candidates are dropped once per edge
+  prune(List, Cld);
 }
 
-// Recursive adding wires, buffers and prunning inferior solutions
-std::list<Params> BufferInsertVG::recursiveVanGin(Node *N) {
+// Solutions at V.N from the solved children, extended up to the parent.
+// Children lists are consumed.
+void BufferInsertVG::solveNode(const Visit &V,
+                               CountedVector<CandidateList> &Solved) {
+  // Pool workers start in no phase
+  MemPhaseScope Phase(MemPhase::DP);
+  Node *N = V.N;
+  auto *Stats = profiled(N->ID);
+  if (Stats) {
+    Stats->ID = N->ID;
+    Stats->Parent = V.Parent ? V.Parent->ID : -1;
+    Stats->Children = N->Children.size();
+    Stats->Thread = Pool ? Pool->currentWorker() + 1 : 0;
+    Stats->Start = Profile->now();
+  }
+  CandidateList List;
   if ((N->ID > 0) && (N->ID < CountSinks + 1)) {
     // sink - tree leaf
-    return N->CapsRATs;
-  }
-
-  std::vector<std::list<Params>> ChildParams;
-  for (auto i = 0; i < int(N->Children.size()); ++i) {
-    Node *Cld = N->Children[i];
-    auto LenCld = N->Lens[i];
-    auto CldParams = recursiveVanGin(Cld);
-
-    if (LenCld == 0) {
-      insertBuffer(CldParams, N, Cld, 0);
-      pruneSolutions(CldParams);
-    } else if (Cld->ID < CountSinks + 1) {
-      for (auto j = 1; j <= LenCld; ++j) {
-        addWire(CldParams, N, Cld, 1);
-        insertBuffer(CldParams, N, Cld, j);
-        pruneSolutions(CldParams);
-      }
-    } else {
-      for (auto j = 0; j < LenCld; ++j) {
-        addWire(CldParams, N, Cld, 1);
-        insertBuffer(CldParams, N, Cld, j);
-        pruneSolutions(CldParams);
-      }
+    List = N->CapsRATs;
+    if (Stats)
+      countChange(*Stats, List, 0, List.dropped());
+  } else {
+    if (N->Children.empty())
+      throw std::runtime_error("Steiner point " + std::to_string(N->ID) +
+                               " drives no sinks");
+    CountedVector<CandidateList> ChildParams;
+    ChildParams.reserve(N->Children.size());
+    for (auto *Cld : N->Children) {
+      if (Opts.Incremental)
+        ChildParams.push_back(Solved[Cld->ID]);
+      else
+        ChildParams.push_back(std::move(Solved[Cld->ID]));
     }
+    List = mergeBranches(ChildParams, N);
+    prune(List, N);
+  }
+  if (Stats)
+    Stats->MergeEnd = Profile->now();
+  if (V.Parent)
+    extendToParent(List, V);
+  if (Stats) {
+    Stats->Surviving = List.size();
+    Stats->End = Profile->now();
+  }
+  Solved[N->ID] = std::move(List);
+}
 
-    ChildParams.push_back(CldParams);
+// Small subtrees are solved serially inside one task. The task finishing the
+// last child of a node goes on with that node, so nodes above the cutoff need
+// no tasks of their own and nothing waits. Merge orders do not depend on the
+// schedule, neither does the result.
+void BufferInsertVG::solveParallel(const std::vector<Visit> &Order,
+                                   CountedVector<CandidateList> &Solved) {
+  auto Count = Order.size();
+  std::vector<size_t> Position(CountIDs);
+  std::vector<long> Work(Count);
+  std::vector<size_t> Size(Count, 1);
+  std::vector<long> ParentPos(Count, -1);
+  for (size_t P = 0; P < Count; ++P) {
+    Node *N = Order[P].N;
+    Position[N->ID] = P;
+    Work[P] = 1 + (Order[P].Parent ? Order[P].Parent->Lens[Order[P].Idx] : 0);
+    for (auto *Cld : N->Children) {
+      auto C = Position[Cld->ID];
+      Work[P] += Work[C];
+      Size[P] += Size[C];
+      ParentPos[C] = P;
+    }
   }
 
-  auto Middle = mergeBranches(ChildParams, N);
-  pruneSolutions(Middle);
-  return Middle;
+  auto Pending = std::make_unique<std::atomic<size_t>[]>(Count);
+  for (size_t P = 0; P < Count; ++P)
+    Pending[P] = Order[P].N->Children.size();
+
+  TaskGroup Group(*Pool);
+  for (size_t P = 0; P < Count; ++P) {
+    bool Small = Work[P] < ForkCutoff || Order[P].N->Children.empty();
+    if (!Small || (ParentPos[P] >= 0 && Work[ParentPos[P]] < ForkCutoff))
+      continue;
+    Group.run([&, P] {
+      for (size_t Q = P + 1 - Size[P]; Q <= P; ++Q)
+        solveNode(Order[Q], Solved);
+      for (auto Up = ParentPos[P]; Up >= 0 && --Pending[Up] == 0;
+           Up = ParentPos[Up])
+        solveNode(Order[Up], Solved);
+    });
+  }
+  Group.wait();
 }
 
 } // namespace VG
@@ -0,0 +1,292 @@
+#include "CandidateKernels.h"
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VG_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace VG::Kernels {
+
+namespace {
+
+// Finite sentinel, the release build may assume finite math
+constexpr auto NegInf = std::numeric_limits<double>::lowest();
+
+void applyWireScalar(double *C, double *RAT, size_t N, double WireR,
+                     double OffsetC, double OffsetRAT) {
+  for (size_t I = 0; I < N; ++I) {
+    RAT[I] = RAT[I] - WireR * C[I] + OffsetRAT;
+    C[I] = C[I] + OffsetC;
+  }
+}
+
+size_t bestBufferedScalar(const double *C, const double *RAT, size_t N,
+                          double R) {
+  size_t Best = 0;
+  double BestVal = RAT[0] - R * C[0];
+  for (size_t I = 1; I < N; ++I) {
+    double Val = RAT[I] - R * C[I];
+    if (Val > BestVal)
+      Best = I, BestVal = Val;
+  }
+  return Best;
+}
+
+size_t selectNonDominatedScalar(const double *RAT, size_t N, uint32_t *Kept) {
+  size_t Count = 0;
+  double Max = NegInf;
+  for (size_t I = 0; I < N; ++I) {
+    if (RAT[I] > Max) {
+      Kept[Count++] = uint32_t(I);
+      Max = RAT[I];
+    }
+  }
+  return Count;
+}
+
+#ifdef VG_KERNELS_X86
+
+// Lane results are merged by value, the lower index wins on ties
+inline void mergeLane(double Val, double Idx, double &BestVal,
+                      double &BestIdx) {
+  if (Val > BestVal || (Val == BestVal && Idx < BestIdx))
+    BestVal = Val, BestIdx = Idx;
+}
+
+__attribute__((target("sse2"))) void
+applyWireSSE2(double *C, double *RAT, size_t N, double WireR, double OffsetC,
+              double OffsetRAT) {
+  auto VR = _mm_set1_pd(WireR);
+  auto VC = _mm_set1_pd(OffsetC);
+  auto VRAT = _mm_set1_pd(OffsetRAT);
+  size_t I = 0;
+  for (; I + 2 <= N; I += 2) {
+    auto Cap = _mm_loadu_pd(C + I);
+    auto Rat = _mm_loadu_pd(RAT + I);
+    Rat = _mm_add_pd(_mm_sub_pd(Rat, _mm_mul_pd(VR, Cap)), VRAT);
+    _mm_storeu_pd(RAT + I, Rat);
+    _mm_storeu_pd(C + I, _mm_add_pd(Cap, VC));
+  }
+  applyWireScalar(C + I, RAT + I, N - I, WireR, OffsetC, OffsetRAT);
+}
+
+__attribute__((target("sse2"))) size_t
+bestBufferedSSE2(const double *C, const double *RAT, size_t N, double R) {
+  if (N < 2)
+    return 0;
+  auto VR = _mm_set1_pd(R);
+  auto Idx = _mm_set_pd(1, 0);
+  auto Step = _mm_set1_pd(2);
+  auto BestVal = _mm_sub_pd(_mm_loadu_pd(RAT), _mm_mul_pd(VR, _mm_loadu_pd(C)));
+  auto BestIdx = Idx;
+  size_t I = 2;
+  for (; I + 2 <= N; I += 2) {
+    Idx = _mm_add_pd(Idx, Step);
+    auto Val =
+        _mm_sub_pd(_mm_loadu_pd(RAT + I), _mm_mul_pd(VR, _mm_loadu_pd(C + I)));
+    auto Better = _mm_cmpgt_pd(Val, BestVal);
+    BestVal = _mm_or_pd(_mm_and_pd(Better, Val), _mm_andnot_pd(Better, BestVal));
+    BestIdx = _mm_or_pd(_mm_and_pd(Better, Idx), _mm_andnot_pd(Better, BestIdx));
+  }
+  alignas(16) double Vals[2], Idxs[2];
+  _mm_store_pd(Vals, BestVal);
+  _mm_store_pd(Idxs, BestIdx);
+  double Val = Vals[0], Best = Idxs[0];
+  mergeLane(Vals[1], Idxs[1], Val, Best);
+  for (; I < N; ++I)
+    mergeLane(RAT[I] - R * C[I], double(I), Val, Best);
+  return size_t(Best);
+}
+
+__attribute__((target("sse2"))) size_t
+selectNonDominatedSSE2(const double *RAT, size_t N, uint32_t *Kept) {
+  auto VNegInf = _mm_set1_pd(NegInf);
+  auto Carry = VNegInf;
+  size_t Count = 0;
+  size_t I = 0;
+  for (; I + 2 <= N; I += 2) {
+    auto X = _mm_loadu_pd(RAT + I);
+    // Inclusive prefix max inside the pair, then the exclusive one
+    auto Prefix = _mm_max_pd(X, _mm_unpacklo_pd(VNegInf, X));
+    auto Before = _mm_max_pd(_mm_unpacklo_pd(VNegInf, Prefix), Carry);
+    int Mask = _mm_movemask_pd(_mm_cmpgt_pd(X, Before));
+    if (Mask & 1)
+      Kept[Count++] = uint32_t(I);
+    if (Mask & 2)
+      Kept[Count++] = uint32_t(I + 1);
+    Carry = _mm_max_pd(Carry, _mm_unpackhi_pd(Prefix, Prefix));
+  }
+  double Max = _mm_cvtsd_f64(Carry);
+  for (; I < N; ++I) {
+    if (RAT[I] > Max) {
+      Kept[Count++] = uint32_t(I);
+      Max = RAT[I];
+    }
+  }
+  return Count;
+}
+
+__attribute__((target("avx2"))) void
+applyWireAVX2(double *C, double *RAT, size_t N, double WireR, double OffsetC,
+              double OffsetRAT) {
+  auto VR = _mm256_set1_pd(WireR);
+  auto VC = _mm256_set1_pd(OffsetC);
+  auto VRAT = _mm256_set1_pd(OffsetRAT);
+  size_t I = 0;
+  for (; I + 4 <= N; I += 4) {
+    auto Cap = _mm256_loadu_pd(C + I);
+    auto Rat = _mm256_loadu_pd(RAT + I);
+    Rat = _mm256_add_pd(_mm256_sub_pd(Rat, _mm256_mul_pd(VR, Cap)), VRAT);
+    _mm256_storeu_pd(RAT + I, Rat);
+    _mm256_storeu_pd(C + I, _mm256_add_pd(Cap, VC));
+  }
+  applyWireScalar(C + I, RAT + I, N - I, WireR, OffsetC, OffsetRAT);
+}
+
+__attribute__((target("avx2"))) size_t
+bestBufferedAVX2(const double *C, const double *RAT, size_t N, double R) {
+  if (N < 4)
+    return bestBufferedScalar(C, RAT, N, R);
+  auto VR = _mm256_set1_pd(R);
+  auto Idx = _mm256_set_pd(3, 2, 1, 0);
+  auto Step = _mm256_set1_pd(4);
+  auto BestVal =
+      _mm256_sub_pd(_mm256_loadu_pd(RAT), _mm256_mul_pd(VR, _mm256_loadu_pd(C)));
+  auto BestIdx = Idx;
+  size_t I = 4;
+  for (; I + 4 <= N; I += 4) {
+    Idx = _mm256_add_pd(Idx, Step);
+    auto Val = _mm256_sub_pd(_mm256_loadu_pd(RAT + I),
+                             _mm256_mul_pd(VR, _mm256_loadu_pd(C + I)));
+    auto Better = _mm256_cmp_pd(Val, BestVal, _CMP_GT_OQ);
+    BestVal = _mm256_blendv_pd(BestVal, Val, Better);
+    BestIdx = _mm256_blendv_pd(BestIdx, Idx, Better);
+  }
+  alignas(32) double Vals[4], Idxs[4];
+  _mm256_store_pd(Vals, BestVal);
+  _mm256_store_pd(Idxs, BestIdx);
+  double Val = Vals[0], Best = Idxs[0];
+  for (int Lane = 1; Lane < 4; ++Lane)
+    mergeLane(Vals[Lane], Idxs[Lane], Val, Best);
+  for (; I < N; ++I)
+    mergeLane(RAT[I] - R * C[I], double(I), Val, Best);
+  return size_t(Best);
+}
+
+__attribute__((target("avx2"))) size_t
+selectNonDominatedAVX2(const double *RAT, size_t N, uint32_t *Kept) {
+  auto VNegInf = _mm256_set1_pd(NegInf);
+  auto Carry = VNegInf;
+  size_t Count = 0;
+  size_t I = 0;
+  for (; I + 4 <= N; I += 4) {
+    auto X = _mm256_loadu_pd(RAT + I);
+    // Lanes shifted up by one and two, the freed lanes get the sentinel
+    auto Prefix = _mm256_max_pd(
+        X, _mm256_blend_pd(_mm256_permute4x64_pd(X, 0x93), VNegInf, 0x1));
+    Prefix = _mm256_max_pd(
+        Prefix,
+        _mm256_blend_pd(_mm256_permute4x64_pd(Prefix, 0x4E), VNegInf, 0x3));
+    auto Before = _mm256_max_pd(
+        _mm256_blend_pd(_mm256_permute4x64_pd(Prefix, 0x93), VNegInf, 0x1),
+        Carry);
+    int Mask = _mm256_movemask_pd(_mm256_cmp_pd(X, Before, _CMP_GT_OQ));
+    for (int Lane = 0; Lane < 4; ++Lane)
+      if (Mask & (1 << Lane))
+        Kept[Count++] = uint32_t(I + Lane);
+    Carry = _mm256_max_pd(Carry, _mm256_permute4x64_pd(Prefix, 0xFF));
+  }
+  double Max = _mm256_cvtsd_f64(Carry);
+  for (; I < N; ++I) {
+    if (RAT[I] > Max) {
+      Kept[Count++] = uint32_t(I);
+      Max = RAT[I];
+    }
+  }
+  return Count;
+}
+
+#endif // VG_KERNELS_X86
+
+struct KernelTable {
+  Isa Level;
+  void (*ApplyWire)(double *, double *, size_t, double, double, double);
+  size_t (*BestBuffered)(const double *, const double *, size_t, double);
+  size_t (*SelectNonDominated)(const double *, size_t, uint32_t *);
+};
+
+bool supported(Isa Target) {
+  switch (Target) {
+  case Isa::Scalar:
+    return true;
+#ifdef VG_KERNELS_X86
+  case Isa::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case Isa::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+KernelTable makeTable(Isa Target) {
+  switch (Target) {
+#ifdef VG_KERNELS_X86
+  case Isa::AVX2:
+    return {Isa::AVX2, applyWireAVX2, bestBufferedAVX2,
+            selectNonDominatedAVX2};
+  case Isa::SSE2:
+    return {Isa::SSE2, applyWireSSE2, bestBufferedSSE2,
+            selectNonDominatedSSE2};
+#endif
+  default:
+    return {Isa::Scalar, applyWireScalar, bestBufferedScalar,
+            selectNonDominatedScalar};
+  }
+}
+
+KernelTable &table() {
+  static KernelTable Table = makeTable(
+      supported(Isa::AVX2) ? Isa::AVX2
+                           : (supported(Isa::SSE2) ? Isa::SSE2 : Isa::Scalar));
+  return Table;
+}
+
+} // namespace
+
+Isa active() { return table().Level; }
+
+bool select(Isa Target) {
+  if (!supported(Target))
+    return false;
+  table() = makeTable(Target);
+  return true;
+}
+
+const char *name(Isa Target) {
+  switch (Target) {
+  case Isa::AVX2:
+    return "avx2";
+  case Isa::SSE2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
+
+void applyWire(double *C, double *RAT, size_t N, double WireR, double OffsetC,
+               double OffsetRAT) {
+  table().ApplyWire(C, RAT, N, WireR, OffsetC, OffsetRAT);
+}
+
+size_t bestBuffered(const double *C, const double *RAT, size_t N, double R) {
+  return table().BestBuffered(C, RAT, N, R);
+}
+
+size_t selectNonDominated(const double *RAT, size_t N, uint32_t *Kept) {
+  return table().SelectNonDominated(RAT, N, Kept);
+}
+
+} // namespace VG::Kernels
@@ -0,0 +1,320 @@
+#include "CandidateList.h"
+#include "CandidateKernels.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+namespace VG {
+
+bool RATHull::intersect(LineSet::iterator First, LineSet::iterator Second) {
+  // Finite sentinel, the release build may assume finite math
+  constexpr auto Inf = std::numeric_limits<double>::max();
+  if (Second == Lines.end()) {
+    First->End = Inf;
+    return false;
+  }
+  if (First->Slope == Second->Slope)
+    First->End = First->Intercept > Second->Intercept ? Inf : -Inf;
+  else
+    First->End = (Second->Intercept - First->Intercept) /
+                 (First->Slope - Second->Slope);
+  return First->End >= Second->End;
+}
+
+void RATHull::add(double C, double RAT, const SolutionRecord *Hist) {
+  auto Next = Lines.insert({-C, RAT, 0, Hist});
+  auto Cur = Next++;
+  auto Prev = Cur;
+  while (intersect(Cur, Next))
+    Next = Lines.erase(Next);
+  // Of lines with equal slope the higher intercept stays, the newer one on
+  // a tie. A lost older line is erased, or left with End -Inf in front.
+  if (Prev != Lines.begin() && intersect(--Prev, Cur))
+    intersect(Prev, Cur = Lines.erase(Cur));
+  while ((Cur = Prev) != Lines.begin() && (--Prev)->End >= Cur->End)
+    intersect(Prev, Lines.erase(Cur));
+}
+
+std::pair<double, const SolutionRecord *> RATHull::query(double X) const {
+  assert(!Lines.empty());
+  auto Best = Lines.lower_bound(X);
+  return {Best->Slope * X + Best->Intercept, Best->Hist};
+}
+
+void CandidateList::pushRaw(double C, double RAT,
+                            const SolutionRecord *Hist) {
+  Caps.push_back(C);
+  RATs.push_back(RAT);
+  Hists.push_back(Hist);
+  if (HullBuilt)
+    Hull.add(C, RAT, Hist);
+}
+
+// A built hull keeps the line: pushBuffered() only pops candidates the one
+// it pushes next dominates, so a query returns the stale line at most where
+// both give the same RAT, and its history is still valid.
+void CandidateList::popBack() {
+  ++Dropped;
+  Caps.pop_back();
+  RATs.pop_back();
+  Hists.pop_back();
+}
+
+void CandidateList::push_back(const Params &Actual) {
+  auto RawC = Actual.C - OffsetC;
+  if (size() > BufferedBegin || (!empty() && RawC < Caps.back()))
+    Sorted = false;
+  pushRaw(RawC, Actual.RAT + WireR * RawC - OffsetRAT, Actual.Hist);
+  BufferedBegin = size();
+}
+
+void CandidateList::clear() {
+  Caps.clear();
+  RATs.clear();
+  Hists.clear();
+  BufferedBegin = 0;
+  Sorted = true;
+  Dropped = 0;
+  Slack = 0;
+  WireR = OffsetC = OffsetRAT = 0;
+  HullBuilt = false;
+  Hull.clear();
+}
+
+size_t CandidateList::capacityBytes() const {
+  return Caps.capacity() * sizeof(double) + RATs.capacity() * sizeof(double) +
+         Hists.capacity() * sizeof(const SolutionRecord *);
+}
+
+void CandidateList::addWire(const TechParams &UnitWire, int Len) {
+  // RAT -= R * L * C + R * C_unit * L^2 / 2, C += C_unit * L
+  double R = UnitWire.R * double(Len);
+  OffsetRAT -= R * OffsetC + R * UnitWire.C * double(Len) / 2;
+  WireR += R;
+  OffsetC += UnitWire.C * double(Len);
+}
+
+std::pair<double, const SolutionRecord *>
+CandidateList::bestDriven(double R) {
+  assert(!empty());
+  auto X = WireR + R;
+  double Best;
+  const SolutionRecord *Hist;
+  if (!HullBuilt && size() <= HullThreshold) {
+    auto Idx = Kernels::bestBuffered(Caps.data(), RATs.data(), size(), X);
+    Best = RATs[Idx] - X * Caps[Idx];
+    Hist = Hists[Idx];
+  } else {
+    if (!HullBuilt) {
+      for (size_t I = 0; I < size(); ++I)
+        Hull.add(Caps[I], RATs[I], Hists[I]);
+      HullBuilt = true;
+    }
+    std::tie(Best, Hist) = Hull.query(X);
+  }
+  return {Best + OffsetRAT - R * OffsetC, Hist};
+}
+
+void CandidateList::pushBuffered(double C, double RAT,
+                                 const SolutionRecord *Hist) {
+  // Earlier buffered candidates only gained caps since, drop the ones that
+  // lost RAT too. Caps are compared raw, both sides round the same way.
+  auto RawC = C - OffsetC;
+  while (size() > BufferedBegin && Caps.back() >= RawC &&
+         actualRAT(size() - 1) <= RAT)
+    popBack();
+  pushRaw(RawC, RAT + WireR * RawC - OffsetRAT, Hist);
+
+  // Usually the smallest cap so far. A larger cell at a later site may
+  // exceed the last few, it goes in front of them and of equal caps so that
+  // the tail read backwards keeps the insertion order.
+  auto Pos = size() - 1;
+  while (Pos > BufferedBegin && Caps[Pos - 1] <= RawC)
+    --Pos;
+  if (Pos + 1 < size()) {
+    std::rotate(Caps.begin() + Pos, Caps.end() - 1, Caps.end());
+    std::rotate(RATs.begin() + Pos, RATs.end() - 1, RATs.end());
+    std::rotate(Hists.begin() + Pos, Hists.end() - 1, Hists.end());
+  }
+}
+
+Params CandidateList::insertBuffer(const TechParams &Buffer,
+                                   const BufPlace &Place,
+                                   SolutionArena &History) {
+  // All buffered candidates share the buffer cap, only the best one survives
+  auto [Best, Hist] = bestDriven(Buffer.R);
+  pushBuffered(Buffer.C, Best - Buffer.IntrinsicDel,
+               History.addBuffer(Place, Hist));
+  return at(size() - 1);
+}
+
+void CandidateList::insertBuffers(const BufferLibrary &Library,
+                                  const std::vector<int> &Cells,
+                                  BufPlace Place, SolutionArena &History) {
+  struct Driven {
+    int Cell;
+    double RAT;
+    const SolutionRecord *Hist;
+  };
+  // Query every cell before inserting: a buffer does not drive another one
+  // placed at the same site
+  thread_local std::vector<Driven> Kept;
+  Kept.clear();
+  for (auto Cell : Cells) {
+    const auto &Buffer = Library[Cell];
+    auto [Best, Hist] = bestDriven(Buffer.R);
+    auto RAT = Best - Buffer.IntrinsicDel;
+    if (Kept.empty() || RAT > Kept.back().RAT)
+      Kept.push_back({Cell, RAT, Hist});
+  }
+  // Largest caps first, so the smallest one ends the buffered tail
+  for (auto It = Kept.rbegin(); It != Kept.rend(); ++It) {
+    Place.Cell = It->Cell;
+    pushBuffered(Library[It->Cell].C, It->RAT,
+                 History.addBuffer(Place, It->Hist));
+  }
+}
+
+void CandidateList::applyPending() {
+  Kernels::applyWire(Caps.data(), RATs.data(), size(), WireR, OffsetC,
+                     OffsetRAT);
+  WireR = OffsetC = OffsetRAT = 0;
+  Hull.clear();
+  HullBuilt = false;
+}
+
+size_t CandidateList::prune(double Epsilon) {
+  applyPending();
+  if (Sorted)
+    mergeSweep();
+  else
+    sortSweep();
+  BufferedBegin = size();
+  Sorted = true;
+  auto Thinned = Epsilon > 0 ? thin(Epsilon) : 0;
+  assert(pruned());
+  return Thinned;
+}
+
+// The ascending prefix and the descending tail are merged, prefix first on
+// equal caps. A candidate is kept if its RAT beats every one before it, of
+// equal caps the one with the best RAT stays. Same result as sorting by
+// caps with larger RATs first.
+void CandidateList::mergeSweep() {
+  thread_local CountedVector<double> NewCaps, NewRATs;
+  thread_local CountedVector<const SolutionRecord *> NewHists;
+  NewCaps.clear();
+  NewRATs.clear();
+  NewHists.clear();
+  double Best = std::numeric_limits<double>::lowest();
+  auto Take = [&](size_t I) {
+    if (RATs[I] <= Best)
+      return;
+    if (!NewCaps.empty() && NewCaps.back() == Caps[I]) {
+      NewCaps.pop_back();
+      NewRATs.pop_back();
+      NewHists.pop_back();
+    }
+    NewCaps.push_back(Caps[I]);
+    NewRATs.push_back(RATs[I]);
+    NewHists.push_back(Hists[I]);
+    Best = RATs[I];
+  };
+  size_t Prefix = 0;
+  size_t Tail = size();
+  while (Prefix < BufferedBegin || Tail > BufferedBegin) {
+    if (Tail == BufferedBegin ||
+        (Prefix < BufferedBegin && Caps[Prefix] <= Caps[Tail - 1]))
+      Take(Prefix++);
+    else
+      Take(--Tail);
+  }
+  Dropped += size() - NewCaps.size();
+  Caps.assign(NewCaps.begin(), NewCaps.end());
+  RATs.assign(NewRATs.begin(), NewRATs.end());
+  Hists.assign(NewHists.begin(), NewHists.end());
+}
+
+void CandidateList::sortSweep() {
+  // Sort by caps, larger RAT first among equal caps: then a candidate is
+  // kept only if its RAT beats every candidate before it
+  CountedVector<uint32_t> Order(size());
+  std::iota(Order.begin(), Order.end(), 0);
+  std::stable_sort(Order.begin(), Order.end(), [this](auto A, auto B) {
+    return Caps[A] < Caps[B] || (Caps[A] == Caps[B] && RATs[A] > RATs[B]);
+  });
+  CountedVector<double> SortedRATs(size());
+  for (size_t I = 0; I < size(); ++I)
+    SortedRATs[I] = RATs[Order[I]];
+
+  CountedVector<uint32_t> Kept(size());
+  auto Count =
+      Kernels::selectNonDominated(SortedRATs.data(), size(), Kept.data());
+
+  CountedVector<double> NewCaps(Count), NewRATs(Count);
+  CountedVector<const SolutionRecord *> NewHists(Count);
+  for (size_t I = 0; I < Count; ++I) {
+    auto From = Order[Kept[I]];
+    NewCaps[I] = Caps[From];
+    NewRATs[I] = RATs[From];
+    NewHists[I] = Hists[From];
+  }
+  Dropped += size() - Count;
+  Caps = std::move(NewCaps);
+  RATs = std::move(NewRATs);
+  Hists = std::move(NewHists);
+}
+
+// Caps and RATs grow along a pruned list, so a dropped candidate is replaced
+// by one with a smaller cap and a RAT at most Gap lower. Whatever is built on
+// the dropped one can be built on the kept one with no more than Gap lost.
+size_t CandidateList::thin(double Epsilon) {
+  size_t Kept = 0;
+  double Gap = 0;
+  for (size_t I = 1; I < size(); ++I) {
+    auto Lost = RATs[I] - RATs[Kept];
+    if (Caps[I] <= Caps[Kept] * (1 + Epsilon) &&
+        Lost <= Epsilon * std::abs(RATs[Kept])) {
+      Gap = std::max(Gap, Lost);
+      continue;
+    }
+    ++Kept;
+    Caps[Kept] = Caps[I];
+    RATs[Kept] = RATs[I];
+    Hists[Kept] = Hists[I];
+  }
+  auto Thinned = empty() ? 0 : size() - Kept - 1;
+  Caps.resize(size() - Thinned);
+  RATs.resize(Caps.size());
+  Hists.resize(Caps.size());
+  BufferedBegin = size();
+  Dropped += Thinned;
+  Slack += Gap;
+  return Thinned;
+}
+
+bool CandidateList::ordered() const {
+  if (!Sorted)
+    return false;
+  for (size_t I = 1; I < size(); ++I) {
+    if (I < BufferedBegin && Caps[I] < Caps[I - 1])
+      return false;
+    if (I > BufferedBegin && Caps[I] > Caps[I - 1])
+      return false;
+  }
+  return true;
+}
+
+bool CandidateList::pruned() const {
+  if (BufferedBegin != size() || !ordered())
+    return false;
+  for (size_t I = 1; I < size(); ++I)
+    if (Caps[I] <= Caps[I - 1] || actualRAT(I) <= actualRAT(I - 1))
+      return false;
+  return true;
+}
+
+} // namespace VG
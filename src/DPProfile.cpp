@@ -0,0 +1,91 @@
+#include "DPProfile.h"
+#include <algorithm>
+#include <string>
+
+namespace VG {
+
+namespace {
+
+const char *const PhaseNames[PhaseCount] = {"wire", "buffer", "prune",
+                                            "merge"};
+
+double micros(uint64_t Nanos) { return Nanos / 1000.0; }
+
+void writeSlice(std::ostream &OS, bool &First, const char *Name, int ID,
+                const NodeProfile &N, uint64_t Begin, uint64_t End) {
+  OS << (First ? "\n" : ",\n") << "{\"name\":\"" << Name << "\",\"cat\":\"dp\""
+     << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << N.Thread
+     << ",\"ts\":" << micros(Begin) << ",\"dur\":" << micros(End - Begin)
+     << ",\"args\":{\"node\":" << ID << "}}";
+  First = false;
+}
+
+} // namespace
+
+void DPProfile::start(int CountIDs) {
+  Nodes.assign(CountIDs, {});
+  Origin = Clock::now();
+}
+
+std::vector<NodeProfile> DPProfile::nodes() const {
+  std::vector<NodeProfile> Solved;
+  for (const auto &N : Nodes)
+    if (N.ID >= 0)
+      Solved.push_back(N);
+  return Solved;
+}
+
+// Every node is a slice on the track of its thread, with the merge of its
+// children and the wire to its parent nested inside
+void DPProfile::writeChromeTrace(std::ostream &OS) const {
+  auto Solved = nodes();
+  int Threads = 0;
+  for (const auto &N : Solved)
+    Threads = std::max(Threads, N.Thread + 1);
+
+  OS.precision(15);
+  OS << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool First = true;
+  for (int T = 0; T < Threads; ++T) {
+    OS << (First ? "\n" : ",\n")
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << T
+       << ",\"args\":{\"name\":\""
+       << (T ? "worker " + std::to_string(T - 1) : std::string("caller"))
+       << "\"}}";
+    First = false;
+  }
+  for (const auto &N : Solved) {
+    OS << ",\n{\"name\":\"node " << N.ID
+       << "\",\"cat\":\"dp\",\"ph\":\"X\",\"pid\":0,\"tid\":" << N.Thread
+       << ",\"ts\":" << micros(N.Start) << ",\"dur\":" << micros(N.End - N.Start)
+       << ",\"args\":{\"parent\":" << N.Parent
+       << ",\"children\":" << N.Children << ",\"created\":" << N.Created
+       << ",\"pruned\":" << N.Pruned << ",\"surviving\":" << N.Surviving
+       << ",\"peak\":" << N.PeakLength;
+    for (int P = 0; P < PhaseCount; ++P)
+      OS << ",\"" << PhaseNames[P] << "_us\":" << micros(N.Nanos[P]);
+    OS << "}}";
+    if (N.Children)
+      writeSlice(OS, First, "merge", N.ID, N, N.Start, N.MergeEnd);
+    if (N.Parent >= 0)
+      writeSlice(OS, First, "extend", N.ID, N, N.MergeEnd, N.End);
+  }
+  OS << "\n]}\n";
+}
+
+void DPProfile::writeCSV(std::ostream &OS) const {
+  OS << "node,parent,children,thread,created,pruned,surviving,peak";
+  for (auto *Name : PhaseNames)
+    OS << "," << Name << "_ns";
+  OS << ",total_ns\n";
+  for (const auto &N : nodes()) {
+    OS << N.ID << "," << N.Parent << "," << N.Children << "," << N.Thread
+       << "," << N.Created << "," << N.Pruned << "," << N.Surviving << ","
+       << N.PeakLength;
+    for (auto Nanos : N.Nanos)
+      OS << "," << Nanos;
+    OS << "," << N.End - N.Start << "\n";
+  }
+}
+
+} // namespace VG
@@ -1,12 +1,17 @@
 #include "JSONTools.h"
 #include "BufferInsertVG.h"
+#include "MappedFile.h"
+#include "MemStats.h"
+#include <algorithm>
+#include <charconv>
 #include <cmath>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <nlohmann/json.hpp>
-#include <set>
+#include <unordered_map>
 
 // #define DEBUG
 using json = nlohmann::json;
@@ -19,15 +24,15 @@ int calculateManhattanDistance(const std::vector<int> &p1,
 
 int calculateSegmentLength(const std::vector<std::vector<int>> &segments) {
   int totalLength = 0;
-  for (size_t i = 0; i < segments.size() - 1; ++i) {
+  for (size_t i = 0; i + 1 < segments.size(); ++i) {
     totalLength += calculateManhattanDistance(segments[i], segments[i + 1]);
   }
   return totalLength;
 }
 
-VG::TechParams parseTechFile(const std::string &filename) {
-  VG::TechParams wireParams;
+namespace {
 
+json readTechJson(const std::string &filename) {
   std::ifstream file(filename);
   if (!file.is_open()) {
     throw std::runtime_error("Could not open tech file: " + filename);
@@ -35,25 +40,50 @@ VG::TechParams parseTechFile(const std::string &filename) {
 
   json techData;
   file >> techData;
+  return techData;
+}
 
-  // Parse unit wire parameters
+VG::TechParams wireFromJson(const json &techData) {
+  VG::TechParams wireParams;
   wireParams.R = techData["technology"]["unit_wire_resistance"];
   wireParams.C = techData["technology"]["unit_wire_capacitance"];
   wireParams.IntrinsicDel = 0.0f; // Wire has no intrinsic delay
-
   return wireParams;
 }
 
-VG::TechParams parseBufferParams(const std::string &filename) {
-  VG::TechParams bufferParams;
+VG::BufferLibrary libraryFromJson(const json &techData,
+                                  const std::string &filename,
+                                  std::vector<std::string> &cellNames) {
+  VG::BufferLibrary library;
+  cellNames.clear();
+  for (const auto &module : techData["module"]) {
+    if (module["input"].size() == 0) {
+      continue;
+    }
+    auto &input = module["input"][0];
+    VG::TechParams bufferParams;
+    bufferParams.C = input["C"];
+    bufferParams.R = input["R"];
+    bufferParams.IntrinsicDel = input["intrinsic_delay"];
+    library.push_back(bufferParams);
+    cellNames.push_back(module.value("name", ""));
+  }
 
-  std::ifstream file(filename);
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open tech file: " + filename);
+  if (library.empty()) {
+    throw std::runtime_error("No buffer modules in tech file: " + filename);
   }
+  return library;
+}
 
-  json techData;
-  file >> techData;
+} // namespace
+
+VG::TechParams parseTechFile(const std::string &filename) {
+  return wireFromJson(readTechJson(filename));
+}
+
+VG::TechParams parseBufferParams(const std::string &filename) {
+  VG::TechParams bufferParams;
+  json techData = readTechJson(filename);
 
   // Parse buffer parameters
   if (techData["module"].size() > 0) {
@@ -69,56 +99,275 @@ VG::TechParams parseBufferParams(const std::string &filename) {
   return bufferParams;
 }
 
-InputData parseTestFile(const std::string &filename) {
-  InputData data;
+VG::BufferLibrary parseBufferLibrary(const std::string &filename,
+                                     std::vector<std::string> &cellNames) {
+  return libraryFromJson(readTechJson(filename), filename, cellNames);
+}
 
-  std::ifstream file(filename);
-  if (!file.is_open()) {
-    throw std::runtime_error("Could not open test file: " + filename);
+void parseTechnology(const std::string &filename, VG::TechParams &wireParams,
+                     VG::BufferLibrary &library,
+                     std::vector<std::string> &cellNames) {
+  json techData = readTechJson(filename);
+  wireParams = wireFromJson(techData);
+  library = libraryFromJson(techData, filename, cellNames);
+}
+
+void parseTechnologyText(const std::string &text, const std::string &filename,
+                         VG::TechParams &wireParams, VG::BufferLibrary &library,
+                         std::vector<std::string> &cellNames) {
+  json techData = json::parse(text);
+  wireParams = wireFromJson(techData);
+  library = libraryFromJson(techData, filename, cellNames);
+}
+
+int findDriverCell(const InputData &inputData,
+                   const std::vector<std::string> &cellNames) {
+  for (const auto &node : inputData.nodes) {
+    if (node.type == "b") {
+      auto it = std::find(cellNames.begin(), cellNames.end(), node.name);
+      return it == cellNames.end() ? 0 : int(it - cellNames.begin());
+    }
   }
+  return 0;
+}
 
-  json testData;
-  file >> testData;
+namespace {
+
+// Fills InputData straight from parser events, no DOM is built. Only the
+// "node" and "edge" arrays are read, anything else is skipped.
+//   depth 1: top-level keys     depth 2: node/edge arrays
+//   depth 3: node/edge fields   depth 4: vertices, segments
+//   depth 5: segment points
+class NetReader : public json::json_sax_t {
+  enum class Section { Other, Nodes, Edges };
+  enum class Field { Other, Id, X, Y, Type, Name, Capacitance, Rat,
+                     Vertices, Segments };
+  enum : unsigned { HasId = 1, HasX = 2, HasY = 4, HasType = 8, HasName = 16 };
+
+  InputData &data;
+  const std::string &filename;
+  Section section = Section::Other;
+  Field field = Field::Other;
+  int depth = 0;
+  // Depth of the value being skipped, -1 if none
+  int skipFrom = -1;
+  unsigned seen = 0;
+  std::vector<int> point;
+
+  bool skipping() const { return skipFrom >= 0; }
+  bool inRecords() const { return section != Section::Other; }
+
+  void malformed(const std::string &what) const {
+    throw std::runtime_error("Malformed test file " + filename + ": " + what);
+  }
 
-  // Parse nodes
-  for (const auto &node : testData["node"]) {
-    InputNode inputNode;
-    inputNode.id = node["id"];
-    inputNode.x = node["x"];
-    inputNode.y = node["y"];
-    inputNode.type = node["type"];
-    inputNode.name = node["name"];
+  bool enterObject() {
+    if (depth == 0)
+      return true;
+    if (depth != 2 || !inRecords())
+      return false;
+    if (section == Section::Nodes)
+      data.nodes.emplace_back();
+    else
+      data.edges.emplace_back();
+    seen = 0;
+    field = Field::Other;
+    return true;
+  }
 
-    if (node.contains("capacitance")) {
-      inputNode.capacitance = node["capacitance"];
+  void finishRecord() {
+    if (section == Section::Edges) {
+      const auto &edge = data.edges.back();
+      if (!(seen & HasId))
+        malformed("edge " + std::to_string(data.edges.size() - 1) +
+                  " has no id");
+      // Points are checked for two coordinates as they come
+      if (edge.vertices.size() != 2)
+        malformed("edge " + std::to_string(edge.id) +
+                  " needs two vertices");
+      if (edge.segments.size() < 2)
+        malformed("edge " + std::to_string(edge.id) +
+                  " needs at least two segment points");
+      return;
     }
+    static const std::pair<unsigned, const char *> required[] = {
+        {HasId, "id"}, {HasX, "x"}, {HasY, "y"}, {HasType, "type"},
+        {HasName, "name"}};
+    for (const auto &[flag, name] : required)
+      if (!(seen & flag))
+        malformed("node " + std::to_string(data.nodes.size() - 1) +
+                  " has no " + name);
+  }
 
-    if (node.contains("rat")) {
-      inputNode.rat = node["rat"];
+  bool enterArray() {
+    if (depth == 1)
+      return inRecords();
+    if (depth == 3)
+      return section == Section::Edges &&
+             (field == Field::Vertices || field == Field::Segments);
+    if (depth == 4 && field == Field::Segments) {
+      point.clear();
+      return true;
     }
+    return false;
+  }
 
-    data.nodes.push_back(inputNode);
+  void number(double value) {
+    if (depth == 4 && field == Field::Vertices) {
+      data.edges.back().vertices.push_back(int(value));
+      return;
+    }
+    if (depth == 5) {
+      point.push_back(int(value));
+      return;
+    }
+    if (depth != 3)
+      return;
+    if (section == Section::Edges) {
+      if (field == Field::Id)
+        data.edges.back().id = int(value), seen |= HasId;
+      return;
+    }
+    auto &node = data.nodes.back();
+    switch (field) {
+    case Field::Id:
+      node.id = int(value), seen |= HasId;
+      break;
+    case Field::X:
+      node.x = int(value), seen |= HasX;
+      break;
+    case Field::Y:
+      node.y = int(value), seen |= HasY;
+      break;
+    case Field::Capacitance:
+      node.capacitance = float(value);
+      break;
+    case Field::Rat:
+      node.rat = float(value);
+      break;
+    default:
+      break;
+    }
   }
 
-  for (const auto &edge : testData["edge"]) {
-    InputEdge inputEdge;
-    inputEdge.id = edge["id"];
+public:
+  NetReader(InputData &data, const std::string &filename)
+      : data(data), filename(filename) {}
 
-    for (const auto &vertex : edge["vertices"]) {
-      inputEdge.vertices.push_back(vertex);
+  bool null() override { return true; }
+  bool boolean(bool) override { return true; }
+  bool number_integer(number_integer_t value) override {
+    if (!skipping())
+      number(double(value));
+    return true;
+  }
+  bool number_unsigned(number_unsigned_t value) override {
+    if (!skipping())
+      number(double(value));
+    return true;
+  }
+  bool number_float(number_float_t value, const string_t &) override {
+    if (!skipping())
+      number(value);
+    return true;
+  }
+  bool binary(binary_t &) override { return true; }
+
+  bool string(string_t &value) override {
+    if (skipping() || depth != 3 || section != Section::Nodes)
+      return true;
+    if (field == Field::Type)
+      data.nodes.back().type = std::move(value), seen |= HasType;
+    else if (field == Field::Name)
+      data.nodes.back().name = std::move(value), seen |= HasName;
+    return true;
+  }
+
+  bool key(string_t &name) override {
+    if (skipping())
+      return true;
+    if (depth == 1) {
+      section = name == "node"   ? Section::Nodes
+                : name == "edge" ? Section::Edges
+                                 : Section::Other;
+    } else if (depth == 3) {
+      static const std::pair<const char *, Field> fields[] = {
+          {"id", Field::Id},
+          {"x", Field::X},
+          {"y", Field::Y},
+          {"type", Field::Type},
+          {"name", Field::Name},
+          {"capacitance", Field::Capacitance},
+          {"rat", Field::Rat},
+          {"vertices", Field::Vertices},
+          {"segments", Field::Segments}};
+      field = Field::Other;
+      for (const auto &[text, value] : fields)
+        if (name == text)
+          field = value;
     }
+    return true;
+  }
 
-    for (const auto &segment : edge["segments"]) {
-      std::vector<int> point;
-      for (const auto &coord : segment) {
-        point.push_back(coord);
-      }
-      inputEdge.segments.push_back(point);
+  bool start_object(std::size_t) override {
+    if (!skipping() && !enterObject())
+      skipFrom = depth;
+    ++depth;
+    return true;
+  }
+
+  bool end_object() override {
+    --depth;
+    if (skipFrom == depth)
+      skipFrom = -1;
+    else if (!skipping() && depth == 2)
+      finishRecord();
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    if (!skipping() && !enterArray())
+      skipFrom = depth;
+    ++depth;
+    return true;
+  }
+
+  bool end_array() override {
+    --depth;
+    if (skipFrom == depth)
+      skipFrom = -1;
+    else if (!skipping() && depth == 4) {
+      if (point.size() != 2)
+        malformed("edge " + std::to_string(data.edges.back().id) +
+                  " has a point without two coordinates");
+      data.edges.back().segments.push_back(std::move(point));
     }
+    return true;
+  }
 
-    data.edges.push_back(inputEdge);
+  bool parse_error(std::size_t position, const std::string &,
+                   const nlohmann::detail::exception &error) override {
+    malformed("offset " + std::to_string(position) + ": " + error.what());
+    return false;
   }
+};
+
+} // namespace
 
+// The file is mapped and parsed in one pass. Peak memory is the result
+// itself plus the mapping, there is no intermediate DOM.
+InputData parseTestFile(const std::string &filename) {
+  InputData data;
+  MappedFile file(filename, "test file");
+  NetReader reader(data, filename);
+  json::sax_parse(file.begin(), file.end(), &reader);
+  return data;
+}
+
+InputData parseTestText(std::string_view text, const std::string &name) {
+  InputData data;
+  NetReader reader(data, name);
+  json::sax_parse(text.begin(), text.end(), &reader);
   return data;
 }
 
@@ -126,6 +375,7 @@ void convertToVGStructures(InputData &inputData, std::vector<VG::Edge> &edges,
                            std::vector<VG::Node> &nodes,
                            std::map<int, int> &originalToNewId,
                            std::map<int, int> &newToOriginalId) {
+  VG::MemPhaseScope phase(VG::MemPhase::Build);
   edges.clear();
   nodes.clear();
   originalToNewId.clear();
@@ -180,8 +430,10 @@ void convertToVGStructures(InputData &inputData, std::vector<VG::Edge> &edges,
 #ifdef DEBUG
       std::cout << "Node: " << std::endl;
       std::cout << newNodeId << " | " << inputNode.type << " | ";
-      for (const auto &parm : nodes.back().CapsRATs) {
-        std::cout << parm.C << " | " << parm.RAT << std::endl;
+      const auto &capsRATs = nodes.back().CapsRATs;
+      for (size_t i = 0; i < capsRATs.size(); ++i) {
+        std::cout << capsRATs.at(i).C << " | " << capsRATs.at(i).RAT
+                  << std::endl;
       }
 #endif
     }
@@ -214,7 +466,7 @@ void convertToVGStructures(InputData &inputData, std::vector<VG::Edge> &edges,
     edge.End = originalToNewId[originalEnd];
 
     int length = 0;
-    for (size_t i = 0; i < inputEdge.segments.size() - 1; ++i) {
+    for (size_t i = 0; i + 1 < inputEdge.segments.size(); ++i) {
       const auto &p1 = inputEdge.segments[i];
       const auto &p2 = inputEdge.segments[i + 1];
 
@@ -223,7 +475,6 @@ void convertToVGStructures(InputData &inputData, std::vector<VG::Edge> &edges,
       }
     }
     edge.Len = length;
-    edge.IsVisited = false;
 
     edges.push_back(edge);
   }
@@ -236,6 +487,207 @@ void convertToVGStructures(InputData &inputData, std::vector<VG::Edge> &edges,
 #endif
 }
 
+std::vector<NetDelta> parseDeltaFile(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file.is_open())
+    throw std::runtime_error("Could not open delta file: " + filename);
+  json root = json::parse(file, nullptr, false);
+  if (root.is_discarded())
+    throw std::runtime_error("Malformed delta file: " + filename);
+
+  auto malformed = [&](const std::string &what) {
+    return std::runtime_error("Malformed delta file " + filename + ": " +
+                              what);
+  };
+  auto step = [&](const json &object) {
+    if (!object.is_object())
+      throw malformed("a step must be an object");
+    NetDelta delta;
+    for (const auto &node : object.value("node", json::array())) {
+      if (!node.contains("id"))
+        throw malformed("node without id");
+      SinkUpdate update{node["id"].get<int>(), {}, {}};
+      if (node.contains("capacitance"))
+        update.capacitance = node["capacitance"].get<float>();
+      if (node.contains("rat"))
+        update.rat = node["rat"].get<float>();
+      delta.sinks.push_back(update);
+    }
+    for (const auto &edge : object.value("edge", json::array())) {
+      if (!edge.contains("id") || !edge.contains("segments"))
+        throw malformed("edge without id or segments");
+      EdgeUpdate update{edge["id"].get<int>(),
+                        edge["segments"].get<std::vector<std::vector<int>>>()};
+      if (update.segments.size() < 2)
+        throw malformed("edge " + std::to_string(update.id) +
+                        " needs two points at least");
+      for (const auto &point : update.segments)
+        if (point.size() != 2)
+          throw malformed("points must have two coordinates");
+      delta.edges.push_back(std::move(update));
+    }
+    return delta;
+  };
+
+  std::vector<NetDelta> steps;
+  try {
+    if (root.is_array()) {
+      for (const auto &object : root)
+        steps.push_back(step(object));
+    } else {
+      steps.push_back(step(root));
+    }
+  } catch (const json::exception &e) {
+    throw malformed(e.what());
+  }
+  return steps;
+}
+
+VG::Delta applyDelta(InputData &inputData, const NetDelta &delta,
+                     const std::map<int, int> &originalToNewId) {
+  auto engineId = [&](int id) {
+    auto it = originalToNewId.find(id);
+    if (it == originalToNewId.end())
+      throw std::runtime_error("Delta refers to unknown node " +
+                               std::to_string(id));
+    return it->second;
+  };
+
+  VG::Delta changes;
+  for (const auto &update : delta.sinks) {
+    auto node = std::find_if(
+        inputData.nodes.begin(), inputData.nodes.end(),
+        [&](const InputNode &n) { return n.id == update.id; });
+    if (node == inputData.nodes.end() || node->type != "t")
+      throw std::runtime_error("Delta changes node " +
+                               std::to_string(update.id) +
+                               " which is not a sink");
+    node->capacitance = update.capacitance.value_or(node->capacitance);
+    node->rat = update.rat.value_or(node->rat);
+    changes.Sinks.push_back(
+        {engineId(node->id), VG::Params{node->capacitance, node->rat}});
+  }
+  for (const auto &update : delta.edges) {
+    auto edge = std::find_if(
+        inputData.edges.begin(), inputData.edges.end(),
+        [&](const InputEdge &e) { return e.id == update.id; });
+    if (edge == inputData.edges.end() || edge->vertices.size() < 2)
+      throw std::runtime_error("Delta reroutes unknown edge " +
+                               std::to_string(update.id));
+    edge->segments = update.segments;
+    changes.Edges.push_back({engineId(edge->vertices[1]),
+                             calculateSegmentLength(edge->segments)});
+  }
+  return changes;
+}
+
+SiteMap parseSiteFile(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file.is_open())
+    throw std::runtime_error("Could not open site file: " + filename);
+  json root = json::parse(file, nullptr, false);
+  if (root.is_discarded() || !root.is_object())
+    throw std::runtime_error("Malformed site file: " + filename);
+
+  SiteMap sites;
+  auto pitch = [&](const json &value) {
+    int result = value.get<int>();
+    if (result < 1)
+      throw std::runtime_error("Buffer site pitch must be positive in " +
+                               filename);
+    return result;
+  };
+  try {
+    if (root.contains("pitch"))
+      sites.pitch = pitch(root["pitch"]);
+    for (const auto &edge : root.value("edges", json::array())) {
+      int id = edge.at("id").get<int>();
+      if (edge.contains("pitch"))
+        sites.edgePitch[id] = pitch(edge["pitch"]);
+      for (const auto &range : edge.value("blocked", json::array()))
+        sites.edgeBlocked[id].push_back(
+            {range.at(0).get<int>(), range.at(1).get<int>()});
+    }
+    for (const auto &box : root.value("blockages", json::array())) {
+      auto corners = box.get<std::array<int, 4>>();
+      sites.blockages.push_back({std::min(corners[0], corners[2]),
+                                 std::min(corners[1], corners[3]),
+                                 std::max(corners[0], corners[2]),
+                                 std::max(corners[1], corners[3])});
+    }
+  } catch (const json::exception &e) {
+    throw std::runtime_error("Malformed site file " + filename + ": " +
+                             e.what());
+  }
+  return sites;
+}
+
+namespace {
+
+// Distances from the child end of the edge that fall into the rectangle,
+// walking the segments the way findPointAtDistance() does
+void blockedRanges(const std::vector<std::vector<int>> &segments,
+                   const std::array<int, 4> &box,
+                   std::vector<std::pair<int, int>> &ranges) {
+  int walked = 0;
+  for (int i = segments.size() - 2; i >= 0; --i) {
+    const auto &from = segments[i + 1];
+    const auto &to = segments[i];
+    int length = calculateManhattanDistance(from, to);
+    // Rectilinear segments only: one coordinate is fixed, the other moves
+    // by one per unit of distance
+    bool vertical = from[0] == to[0];
+    int fixed = vertical ? from[0] : from[1];
+    int start = vertical ? from[1] : from[0];
+    int step = (vertical ? to[1] : to[0]) >= start ? 1 : -1;
+    int lo = vertical ? box[1] : box[0];
+    int hi = vertical ? box[3] : box[2];
+    int fixedLo = vertical ? box[0] : box[1];
+    int fixedHi = vertical ? box[2] : box[3];
+    if (fixed >= fixedLo && fixed <= fixedHi) {
+      int first = step > 0 ? lo - start : start - hi;
+      int last = step > 0 ? hi - start : start - lo;
+      first = std::max(first, 0);
+      last = std::min(last, length);
+      if (first <= last)
+        ranges.push_back({walked + first, walked + last});
+    }
+    walked += length;
+  }
+}
+
+} // namespace
+
+void applySiteMap(const SiteMap &sites, const InputData &inputData,
+                  std::vector<VG::Edge> &edges,
+                  const std::map<int, int> &originalToNewId) {
+  // Every engine edge is known by its child
+  std::map<int, const InputEdge *> byChild;
+  for (const auto &inputEdge : inputData.edges) {
+    if (inputEdge.vertices.size() < 2)
+      continue;
+    auto child = originalToNewId.find(inputEdge.vertices[1]);
+    if (child != originalToNewId.end())
+      byChild[child->second] = &inputEdge;
+  }
+  for (auto &edge : edges) {
+    auto found = byChild.find(edge.End);
+    if (found == byChild.end())
+      continue;
+    const auto &inputEdge = *found->second;
+    auto pitch = sites.edgePitch.find(inputEdge.id);
+    if (pitch != sites.edgePitch.end())
+      edge.Pitch = pitch->second;
+    auto blocked = sites.edgeBlocked.find(inputEdge.id);
+    if (blocked != sites.edgeBlocked.end())
+      edge.Blocked = blocked->second;
+    if (inputEdge.segments.size() < 2)
+      continue;
+    for (const auto &box : sites.blockages)
+      blockedRanges(inputEdge.segments, box, edge.Blocked);
+  }
+}
+
 // Helper function to find point coordinates at a specific distance from the
 // child
 std::vector<int>
@@ -266,13 +718,210 @@ findPointAtDistance(const std::vector<std::vector<int>> &segments,
   return segments[0];
 }
 
-void writeOutputFile(const std::string &originalFilename,
-                     const InputData &originalData,
-                     const std::vector<VG::BufPlace> &bufferLocations,
-                     const std::map<int, int> &newToOriginalId) {
-  std::filesystem::path inputPath(originalFilename);
-  std::string outputFilename = inputPath.stem().string() + "_out.json";
+NetWriter::NetWriter(bool compact, size_t reserve) : compact(compact) {
+  out.reserve(reserve);
+  out += '{';
+  key("node", 1);
+  out += '[';
+}
+
+void NetWriter::newline(int indent) {
+  if (!compact) {
+    out += '\n';
+    out.append(indent * 4, ' ');
+  }
+}
+
+void NetWriter::integer(int value) {
+  char buffer[16];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, result.ptr);
+}
+
+// Shortest text that reads back as the same float
+void NetWriter::real(float value) {
+  char buffer[32];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, result.ptr);
+}
+
+void NetWriter::string(std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+void NetWriter::key(const char *name, int indent) {
+  newline(indent);
+  out += '"';
+  out += name;
+  out += compact ? "\":" : "\": ";
+}
+
+void NetWriter::beginEdges() {
+  newline(1);
+  out += "],";
+  key("edge", 1);
+  out += '[';
+  inEdges = true;
+  items = 0;
+}
+
+void NetWriter::closeEdge() {
+  if (!edgeOpen)
+    return;
+  newline(3);
+  out += "]";
+  newline(2);
+  out += '}';
+  edgeOpen = false;
+}
+
+void NetWriter::node(int id, int x, int y, std::string_view type,
+                     std::string_view name, float capacitance, float rat) {
+  if (items++)
+    out += ',';
+  newline(2);
+  out += '{';
+  key("id", 3);
+  integer(id);
+  out += ',';
+  key("x", 3);
+  integer(x);
+  out += ',';
+  key("y", 3);
+  integer(y);
+  out += ',';
+  key("type", 3);
+  string(type);
+  out += ',';
+  key("name", 3);
+  string(name);
+  if (type == "t") {
+    out += ',';
+    key("capacitance", 3);
+    real(capacitance);
+    out += ',';
+    key("rat", 3);
+    real(rat);
+  }
+  newline(2);
+  out += '}';
+}
+
+void NetWriter::edge(int id, std::span<const int> vertices) {
+  if (!inEdges)
+    beginEdges();
+  closeEdge();
+  if (items++)
+    out += ',';
+  newline(2);
+  out += '{';
+  key("id", 3);
+  integer(id);
+  out += ',';
+  key("vertices", 3);
+  out += '[';
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    if (i)
+      out += compact ? "," : ", ";
+    integer(vertices[i]);
+  }
+  out += "],";
+  key("segments", 3);
+  out += '[';
+  edgeOpen = true;
+  points = 0;
+}
+
+void NetWriter::point(int x, int y) {
+  if (points++)
+    out += ',';
+  newline(4);
+  out += '[';
+  integer(x);
+  out += compact ? "," : ", ";
+  integer(y);
+  out += ']';
+}
+
+void NetWriter::finish() {
+  if (!inEdges)
+    beginEdges();
+  closeEdge();
+  newline(1);
+  out += ']';
+  newline(0);
+  out += "}\n";
+}
+
+std::string NetWriter::text() const {
+  return std::string(out.begin(), out.end());
+}
+
+void NetWriter::save(const std::string &filename) const {
+  std::FILE *file = std::fopen(filename.c_str(), "wb");
+  if (!file)
+    throw std::runtime_error("Could not open output file: " + filename);
+  bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  written = std::fclose(file) == 0 && written;
+  if (!written)
+    throw std::runtime_error("Could not write output file: " + filename);
+}
+
+namespace {
+
+// Writes the whole net, reserving an upper estimate of the indented layout
+// so reallocation is rare
+NetWriter writeNet(const std::vector<InputNode> &nodes,
+                   const std::vector<InputEdge> &edges, bool compact) {
+  size_t points = 0;
+  for (const auto &edge : edges)
+    points += edge.segments.size();
+  NetWriter writer(compact,
+                   160 * nodes.size() + 120 * edges.size() + 32 * points + 64);
+  for (const auto &node : nodes)
+    writer.node(node.id, node.x, node.y, node.type, node.name,
+                node.capacitance, node.rat);
+  for (const auto &edge : edges) {
+    writer.edge(edge.id, edge.vertices);
+    for (const auto &point : edge.segments)
+      writer.point(point[0], point[1]);
+  }
+  writer.finish();
+  return writer;
+}
 
+} // namespace
+
+void writeTestFile(const std::string &filename, const InputData &data,
+                   bool compact) {
+  VG::MemPhaseScope phase(VG::MemPhase::Output);
+  writeNet(data.nodes, data.edges, compact).save(filename);
+}
+
+std::string writeTestText(const InputData &data, bool compact) {
+  VG::MemPhaseScope phase(VG::MemPhase::Output);
+  return writeNet(data.nodes, data.edges, compact).text();
+}
+
+InputData bufferedNet(const InputData &originalData,
+                      const std::vector<VG::BufPlace> &bufferLocations,
+                      const std::map<int, int> &newToOriginalId,
+                      const std::vector<std::string> &cellNames,
+                      bool verbose) {
+  VG::MemPhaseScope phase(VG::MemPhase::Output);
 #ifdef DEBUG
   for (const auto &buf : bufferLocations) {
     std::cout << "ParentID: " << buf.ParentID << ", ChildID: " << buf.ChildID
@@ -314,12 +963,39 @@ void writeOutputFile(const std::string &originalFilename,
     bufferGroups[{originalParentId, originalChildId}].push_back(bufLoc);
   }
 
-  std::vector<InputEdge> newEdges;
-  std::set<int> edgesToKeep;
-
-  for (const auto &edge : originalData.edges) {
-    edgesToKeep.insert(edge.id);
+  // Lookup tables by original ID and by the unordered vertex pair, the
+  // first node or edge wins like a front-to-back scan would
+  std::unordered_map<
+      int, const InputNode *, std::hash<int>, std::equal_to<int>,
+      VG::CountingAllocator<std::pair<const int, const InputNode *>>>
+      nodeById;
+  nodeById.reserve(originalData.nodes.size());
+  for (const auto &node : originalData.nodes) {
+    nodeById.emplace(node.id, &node);
   }
+  auto vertexKey = [](int a, int b) {
+    return (uint64_t(uint32_t(std::min(a, b))) << 32) | uint32_t(std::max(a, b));
+  };
+  std::unordered_map<
+      uint64_t, size_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+      VG::CountingAllocator<std::pair<const uint64_t, size_t>>>
+      edgeByVertices;
+  edgeByVertices.reserve(originalData.edges.size());
+  for (size_t i = 0; i < originalData.edges.size(); ++i) {
+    const auto &vertices = originalData.edges[i].vertices;
+    if (vertices.size() >= 2)
+      edgeByVertices.emplace(vertexKey(vertices[0], vertices[1]), i);
+  }
+  auto nodePosition = [&](int id) {
+    auto it = nodeById.find(id);
+    if (it == nodeById.end())
+      throw std::runtime_error("Buffer next to unknown node " +
+                               std::to_string(id));
+    return std::vector<int>{it->second->x, it->second->y};
+  };
+
+  std::vector<InputEdge> newEdges;
+  std::vector<bool> edgesToKeep(originalData.edges.size(), true);
 
   for (auto &[edgePair, buffers] : bufferGroups) {
     auto [originalParentId, originalChildId] = edgePair;
@@ -333,40 +1009,32 @@ void writeOutputFile(const std::string &originalFilename,
           continue;
         }
 
-        std::vector<int> nodePosition;
-        for (const auto &node : originalData.nodes) {
-          if (node.id == originalParentId) {
-            nodePosition = {node.x, node.y};
-            break;
-          }
-        }
+        auto position = nodePosition(originalParentId);
 
         int newBufferId = ++maxNodeId;
         InputNode newBuffer = bufferTemplate;
+        if (bufLoc.Cell < int(cellNames.size()))
+          newBuffer.name = cellNames[bufLoc.Cell];
         newBuffer.id = newBufferId;
-        newBuffer.x = nodePosition[0];
-        newBuffer.y = nodePosition[1];
+        newBuffer.x = position[0];
+        newBuffer.y = position[1];
         newNodes.push_back(newBuffer);
 
         InputEdge loopEdge;
         loopEdge.id = ++maxEdgeId;
         loopEdge.vertices = {newBufferId, newBufferId};
-        loopEdge.segments = {nodePosition, nodePosition};
+        loopEdge.segments = {position, position};
         newEdges.push_back(loopEdge);
       }
       continue;
     }
 
-    InputEdge *targetEdge = nullptr;
-    for (auto &edge : originalData.edges) {
-      if ((edge.vertices[0] == originalParentId &&
-           edge.vertices[1] == originalChildId) ||
-          (edge.vertices[0] == originalChildId &&
-           edge.vertices[1] == originalParentId)) {
-        targetEdge = const_cast<InputEdge *>(&edge);
-        edgesToKeep.erase(edge.id);
-        break;
-      }
+    const InputEdge *targetEdge = nullptr;
+    auto edgeIt =
+        edgeByVertices.find(vertexKey(originalParentId, originalChildId));
+    if (edgeIt != edgeByVertices.end()) {
+      targetEdge = &originalData.edges[edgeIt->second];
+      edgesToKeep[edgeIt->second] = false;
     }
 
     if (!targetEdge) {
@@ -388,13 +1056,7 @@ void writeOutputFile(const std::string &originalFilename,
                 return a.Len < b.Len;
               });
 
-    std::vector<int> childPosition;
-    for (const auto &node : originalData.nodes) {
-      if (node.id == originalChildId) {
-        childPosition = {node.x, node.y};
-        break;
-      }
-    }
+    auto childPosition = nodePosition(originalChildId);
 
     struct BufferInfo {
       int id;
@@ -416,14 +1078,15 @@ void writeOutputFile(const std::string &originalFilename,
       }
 
       InputNode newBuffer = bufferTemplate;
+      if (bufLoc.Cell < int(cellNames.size()))
+        newBuffer.name = cellNames[bufLoc.Cell];
       newBuffer.id = info.id;
       newBuffer.x = info.position[0];
       newBuffer.y = info.position[1];
       newNodes.push_back(newBuffer);
-      // #ifdef DEBUG
-      std::cout << " BUFFER " << "(" << newBuffer.x << ", " << newBuffer.y
-                << ")\n";
-      // #endif
+      if (verbose)
+        std::cout << " BUFFER " << "(" << newBuffer.x << ", " << newBuffer.y
+                  << ")\n";
 
       bufferInfos.push_back(info);
     }
@@ -478,50 +1141,31 @@ void writeOutputFile(const std::string &originalFilename,
     }
   }
 
-  for (const auto &edge : originalData.edges) {
-    if (edgesToKeep.find(edge.id) != edgesToKeep.end()) {
-      newEdges.push_back(edge);
+  for (size_t i = 0; i < originalData.edges.size(); ++i) {
+    if (edgesToKeep[i]) {
+      newEdges.push_back(originalData.edges[i]);
     }
   }
+  return {std::move(newNodes), std::move(newEdges)};
+}
 
-  json outputJson;
-
-  json nodeArray = json::array();
-  for (const auto &node : newNodes) {
-    json nodeJson;
-    nodeJson["id"] = node.id;
-    nodeJson["x"] = node.x;
-    nodeJson["y"] = node.y;
-    nodeJson["type"] = node.type;
-    nodeJson["name"] = node.name;
-
-    if (node.type == "t") {
-      nodeJson["capacitance"] = node.capacitance;
-      nodeJson["rat"] = node.rat;
-    }
-
-    nodeArray.push_back(nodeJson);
-  }
-
-  json edgeArray = json::array();
-  for (const auto &edge : newEdges) {
-    json edgeJson;
-    edgeJson["id"] = edge.id;
-    edgeJson["vertices"] = edge.vertices;
-    edgeJson["segments"] = edge.segments;
-    edgeArray.push_back(edgeJson);
-  }
-
-  outputJson["node"] = nodeArray;
-  outputJson["edge"] = edgeArray;
-
-  std::ofstream outFile(outputFilename);
-  if (!outFile.is_open()) {
-    throw std::runtime_error("Could not open output file: " + outputFilename);
-  }
+std::string outputFilename(const std::string &inputFilename) {
+  return std::filesystem::path(inputFilename).stem().string() + "_out.json";
+}
 
-  outFile << outputJson.dump(4); // Pretty print with 4-space indent
-  std::cout << "Output written to " << outputFilename << std::endl;
+void writeOutputFile(const std::string &originalFilename,
+                     const InputData &originalData,
+                     const std::vector<VG::BufPlace> &bufferLocations,
+                     const std::map<int, int> &newToOriginalId,
+                     bool verbose,
+                     const std::vector<std::string> &cellNames, bool compact) {
+  VG::MemPhaseScope phase(VG::MemPhase::Output);
+  auto filename = outputFilename(originalFilename);
+  auto net = bufferedNet(originalData, bufferLocations, newToOriginalId,
+                         cellNames, verbose);
+  writeNet(net.nodes, net.edges, compact).save(filename);
+  if (verbose)
+    std::cout << "Output written to " << filename << std::endl;
 }
 
 std::vector<std::vector<int>>
@@ -540,12 +1184,9 @@ extractSegmentsBetween(const std::vector<std::vector<int>> &segments,
     segmentLengths.push_back(length);
   }
 
-  std::vector<int> distancesFromChild;
-  int cumulativeDistance = 0;
-  distancesFromChild.push_back(cumulativeDistance);
+  std::vector<int> distancesFromChild(segments.size(), 0);
   for (int i = segmentLengths.size() - 1; i >= 0; --i) {
-    cumulativeDistance += segmentLengths[i];
-    distancesFromChild.insert(distancesFromChild.begin(), cumulativeDistance);
+    distancesFromChild[i] = distancesFromChild[i + 1] + segmentLengths[i];
   }
 
   int startSegmentIdx = -1;
@@ -0,0 +1,35 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace JSONTools {
+
+MappedFile::MappedFile(const std::string &filename, const char *what) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(std::string("Could not open ") + what + ": " +
+                             filename);
+  struct stat info;
+  if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+    size_ = info.st_size;
+    void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      ::madvise(mapped, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(mapped);
+    }
+  }
+  ::close(fd);
+  if (size_ == 0)
+    throw std::runtime_error(std::string("Empty ") + what + ": " + filename);
+  if (!data_)
+    throw std::runtime_error(std::string("Could not map ") + what + ": " +
+                             filename);
+}
+
+MappedFile::~MappedFile() { ::munmap(const_cast<char *>(data_), size_); }
+
+} // namespace JSONTools
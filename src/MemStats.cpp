@@ -0,0 +1,95 @@
+#include "MemStats.h"
+#include <atomic>
+#include <iomanip>
+
+namespace VG {
+
+namespace {
+
+struct AtomicCounters {
+  std::atomic<uint64_t> Allocations{0};
+  std::atomic<uint64_t> Bytes{0};
+  std::atomic<uint64_t> PeakLive{0};
+
+  void add(uint64_t Size, uint64_t Live) {
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    Bytes.fetch_add(Size, std::memory_order_relaxed);
+    auto Peak = PeakLive.load(std::memory_order_relaxed);
+    while (Live > Peak &&
+           !PeakLive.compare_exchange_weak(Peak, Live,
+                                           std::memory_order_relaxed))
+      ;
+  }
+
+  MemCounters load() const {
+    return {Allocations.load(std::memory_order_relaxed),
+            Bytes.load(std::memory_order_relaxed),
+            PeakLive.load(std::memory_order_relaxed)};
+  }
+
+  void reset(uint64_t Live) {
+    Allocations = 0;
+    Bytes = 0;
+    PeakLive = Live;
+  }
+};
+
+std::atomic<uint64_t> Live{0};
+AtomicCounters Total;
+AtomicCounters Phases[MemPhaseCount];
+thread_local MemPhase Current = MemPhase::Other;
+
+const char *const PhaseNames[MemPhaseCount] = {"other", "build", "dp",
+                                               "merge", "output"};
+
+} // namespace
+
+const char *memPhaseName(MemPhase P) { return PhaseNames[int(P)]; }
+
+void MemStats::allocated(size_t Bytes) {
+  auto Now = Live.fetch_add(Bytes, std::memory_order_relaxed) + Bytes;
+  Total.add(Bytes, Now);
+  Phases[int(Current)].add(Bytes, Now);
+}
+
+void MemStats::freed(size_t Bytes) {
+  Live.fetch_sub(Bytes, std::memory_order_relaxed);
+}
+
+MemReport MemStats::report() {
+  MemReport Report;
+  Report.Total = Total.load();
+  Report.Live = Live.load(std::memory_order_relaxed);
+  for (int P = 0; P < MemPhaseCount; ++P)
+    Report.Phases[P] = Phases[P].load();
+  return Report;
+}
+
+void MemStats::reset() {
+  auto Now = Live.load(std::memory_order_relaxed);
+  Total.reset(Now);
+  for (auto &Phase : Phases)
+    Phase.reset(Now);
+}
+
+MemPhase MemStats::currentPhase() { return Current; }
+
+MemPhaseScope::MemPhaseScope(MemPhase P) : Saved(Current) { Current = P; }
+
+MemPhaseScope::~MemPhaseScope() { Current = Saved; }
+
+void MemReport::print(std::ostream &OS) const {
+  auto Row = [&](const char *Name, const MemCounters &C) {
+    OS << std::left << std::setw(8) << Name << std::right << std::setw(12)
+       << C.Allocations << std::setw(14) << C.Bytes / 1024 << std::setw(14)
+       << C.PeakLive / 1024 << "\n";
+  };
+  OS << "phase    allocations      total KB  peak live KB\n";
+  for (int P = 0; P < MemPhaseCount; ++P)
+    if (Phases[P].Allocations)
+      Row(PhaseNames[P], Phases[P]);
+  Row("total", Total);
+  OS << "live KB " << Live / 1024 << "\n";
+}
+
+} // namespace VG
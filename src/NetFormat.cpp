@@ -0,0 +1,281 @@
+#include "NetFormat.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace NetFormat {
+
+static_assert(sizeof(Header) == 48 && sizeof(NodeRecord) == 36 &&
+                  sizeof(EdgeRecord) == 20 && sizeof(Point) == 8,
+              "binary net records must not have padding");
+static_assert(std::is_trivially_copyable_v<NodeRecord> &&
+                  std::is_trivially_copyable_v<EdgeRecord>,
+              "binary net records are used in place");
+
+namespace {
+
+[[noreturn]] void malformed(const std::string &filename,
+                            const std::string &what) {
+  throw std::runtime_error("Malformed binary net " + filename + ": " + what);
+}
+
+} // namespace
+
+NetFile::NetFile(const std::string &filename) : file(filename, "net file") {
+  if (file.size() < sizeof(Header))
+    malformed(filename, "truncated header");
+  header = reinterpret_cast<const Header *>(file.begin());
+  if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+    malformed(filename, "bad magic");
+  if (header->byteOrder != ByteOrderMark)
+    malformed(filename, "written with another byte order");
+  if (header->version != Version)
+    malformed(filename, "unsupported version " +
+                            std::to_string(header->version));
+
+  // Sections must add up to the file size exactly, counts are limited so
+  // the sum cannot overflow
+  constexpr uint64_t Limit = uint64_t(1) << 32;
+  if (header->nodeCount >= Limit || header->edgeCount >= Limit ||
+      header->pointCount >= Limit || header->stringBytes >= Limit)
+    malformed(filename, "section too large");
+  uint64_t expected = sizeof(Header) + header->nodeCount * sizeof(NodeRecord) +
+                      header->edgeCount * sizeof(EdgeRecord) +
+                      header->pointCount * sizeof(Point) +
+                      header->stringBytes;
+  if (expected != file.size())
+    malformed(filename, "size does not match the header");
+
+  auto *cursor = file.begin() + sizeof(Header);
+  nodes_ = reinterpret_cast<const NodeRecord *>(cursor);
+  cursor += header->nodeCount * sizeof(NodeRecord);
+  edges_ = reinterpret_cast<const EdgeRecord *>(cursor);
+  cursor += header->edgeCount * sizeof(EdgeRecord);
+  points_ = reinterpret_cast<const Point *>(cursor);
+  cursor += header->pointCount * sizeof(Point);
+  strings = cursor;
+
+  auto inStrings = [&](StringRef ref) {
+    return uint64_t(ref.offset) + ref.length <= header->stringBytes;
+  };
+  for (size_t i = 0; i < nodeCount(); ++i)
+    if (!inStrings(nodes_[i].type) || !inStrings(nodes_[i].name))
+      malformed(filename, "node " + std::to_string(i) + " string is out of range");
+  for (size_t i = 0; i < edgeCount(); ++i) {
+    if (uint64_t(edges_[i].FirstPoint) + edges_[i].PointCount >
+        header->pointCount)
+      malformed(filename, "edge " + std::to_string(i) + " points are out of range");
+    if (edges_[i].PointCount < 2)
+      malformed(filename,
+                "edge " + std::to_string(i) + " has fewer than two points");
+  }
+}
+
+JSONTools::InputData NetFile::toInputData() const {
+  JSONTools::InputData data;
+  data.nodes.resize(nodeCount());
+  for (size_t i = 0; i < nodeCount(); ++i) {
+    const auto &record = nodes_[i];
+    auto &node = data.nodes[i];
+    node.id = record.id;
+    node.x = record.x;
+    node.y = record.y;
+    node.type = string(record.type);
+    node.name = string(record.name);
+    node.capacitance = record.capacitance;
+    node.rat = record.rat;
+  }
+  data.edges.resize(edgeCount());
+  for (size_t i = 0; i < edgeCount(); ++i) {
+    const auto &record = edges_[i];
+    auto &edge = data.edges[i];
+    edge.id = record.ID;
+    edge.vertices = {record.From, record.To};
+    auto *point = points(record);
+    edge.segments.reserve(record.PointCount);
+    for (uint32_t j = 0; j < record.PointCount; ++j)
+      edge.segments.push_back({point[j].X, point[j].Y});
+  }
+  return data;
+}
+
+VG::NetView NetFile::view() {
+  if (netNodes.size() != nodeCount()) {
+    netNodes.clear();
+    netNodes.reserve(nodeCount());
+    for (size_t i = 0; i < nodeCount(); ++i) {
+      const auto &record = nodes_[i];
+      auto type = string(record.type);
+      VG::NodeKind kind;
+      if (type == "b")
+        kind = VG::NodeKind::Driver;
+      else if (type == "t")
+        kind = VG::NodeKind::Sink;
+      else if (type == "s")
+        kind = VG::NodeKind::Steiner;
+      else
+        throw std::runtime_error("Node " + std::to_string(record.id) +
+                                 " has unknown type " + std::string(type));
+      netNodes.push_back({record.id, record.x, record.y, kind,
+                          record.capacitance, record.rat});
+    }
+  }
+  return {netNodes, {edges_, edgeCount()}, {points_, pointCount()}};
+}
+
+const NodeRecord &NetFile::driver() const {
+  for (size_t i = 0; i < nodeCount(); ++i)
+    if (string(nodes_[i].type) == "b")
+      return nodes_[i];
+  throw std::runtime_error("Net has no driver");
+}
+
+int NetFile::driverCell(const std::vector<std::string> &cellNames) const {
+  auto it =
+      std::find(cellNames.begin(), cellNames.end(), string(driver().name));
+  return it == cellNames.end() ? 0 : int(it - cellNames.begin());
+}
+
+bool isBinaryNet(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  char magic[sizeof(Magic)];
+  return file.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+JSONTools::InputData readNet(const std::string &filename) {
+  if (isBinaryNet(filename))
+    return NetFile(filename).toInputData();
+  return JSONTools::parseTestFile(filename);
+}
+
+void writeBinaryNet(const std::string &filename,
+                    const JSONTools::InputData &data) {
+  std::vector<NodeRecord> nodes;
+  std::vector<EdgeRecord> edges;
+  std::vector<Point> points;
+  std::string strings;
+  auto addString = [&](const std::string &text) {
+    StringRef ref{uint32_t(strings.size()), uint32_t(text.size())};
+    strings += text;
+    return ref;
+  };
+
+  nodes.reserve(data.nodes.size());
+  for (const auto &node : data.nodes)
+    nodes.push_back({node.id, node.x, node.y, node.capacitance, node.rat,
+                     addString(node.type), addString(node.name)});
+  edges.reserve(data.edges.size());
+  for (const auto &edge : data.edges) {
+    if (edge.vertices.size() != 2)
+      throw std::runtime_error("Edge " + std::to_string(edge.id) +
+                               " does not have two vertices");
+    edges.push_back({edge.id, edge.vertices[0], edge.vertices[1],
+                     uint32_t(points.size()), uint32_t(edge.segments.size())});
+    for (const auto &point : edge.segments)
+      points.push_back({point[0], point[1]});
+  }
+
+  Header header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.byteOrder = ByteOrderMark;
+  header.nodeCount = nodes.size();
+  header.edgeCount = edges.size();
+  header.pointCount = points.size();
+  header.stringBytes = strings.size();
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    throw std::runtime_error("Could not create net file: " + filename);
+  auto write = [&](const void *bytes, size_t size) {
+    file.write(static_cast<const char *>(bytes), size);
+  };
+  write(&header, sizeof(header));
+  write(nodes.data(), nodes.size() * sizeof(NodeRecord));
+  write(edges.data(), edges.size() * sizeof(EdgeRecord));
+  write(points.data(), points.size() * sizeof(Point));
+  write(strings.data(), strings.size());
+  if (!file)
+    throw std::runtime_error("Could not write net file: " + filename);
+}
+
+std::string_view bufferName(const NetFile &net, const VG::PlacedBuffer &buffer,
+                            const std::vector<std::string> &cellNames) {
+  if (buffer.Cell < int(cellNames.size()))
+    return cellNames[buffer.Cell];
+  return net.string(net.driver().name);
+}
+
+JSONTools::NetWriter bufferedNet(const NetFile &net,
+                                 const VG::BufferedNet &result,
+                                 const std::vector<std::string> &cellNames,
+                                 bool compact) {
+  const auto &driver = net.driver();
+
+  std::vector<bool> split(net.edgeCount());
+  std::vector<int> splitIDs(result.Split);
+  std::sort(splitIDs.begin(), splitIDs.end());
+  for (size_t i = 0; i < net.edgeCount(); ++i)
+    split[i] = std::binary_search(splitIDs.begin(), splitIDs.end(),
+                                  net.edge(i).ID);
+
+  // Same estimate as for the input layout
+  JSONTools::NetWriter writer(
+      compact, 160 * (net.nodeCount() + result.Buffers.size()) +
+                   120 * (net.edgeCount() + result.Pieces.size()) +
+                   32 * (net.pointCount() + result.Points.size()) +
+                   64);
+  for (size_t i = 0; i < net.nodeCount(); ++i) {
+    const auto &node = net.node(i);
+    writer.node(node.id, node.x, node.y, net.string(node.type),
+                net.string(node.name), node.capacitance, node.rat);
+  }
+  for (const auto &buffer : result.Buffers)
+    writer.node(buffer.ID, buffer.At.X, buffer.At.Y, "b",
+                bufferName(net, buffer, cellNames), driver.capacitance,
+                driver.rat);
+  auto edge = [&](const EdgeRecord &record, const Point *points) {
+    std::array<int, 2> vertices{record.From, record.To};
+    writer.edge(record.ID, vertices);
+    for (uint32_t j = 0; j < record.PointCount; ++j)
+      writer.point(points[j].X, points[j].Y);
+  };
+  for (const auto &piece : result.Pieces)
+    edge(piece, result.Points.data() + piece.FirstPoint);
+  for (size_t i = 0; i < net.edgeCount(); ++i)
+    if (!split[i])
+      edge(net.edge(i), net.points(net.edge(i)));
+  writer.finish();
+  return writer;
+}
+
+void writeOutputFile(const std::string &originalFilename, const NetFile &net,
+                     const VG::BufferedNet &result, bool verbose,
+                     const std::vector<std::string> &cellNames, bool compact) {
+  VG::MemPhaseScope phase(VG::MemPhase::Output);
+  if (verbose)
+    for (const auto &buffer : result.Buffers)
+      std::cout << " BUFFER " << "(" << buffer.At.X << ", " << buffer.At.Y
+                << ")\n";
+  auto filename = JSONTools::outputFilename(originalFilename);
+  bufferedNet(net, result, cellNames, compact).save(filename);
+  if (verbose)
+    std::cout << "Output written to " << filename << std::endl;
+}
+
+bool convertNet(const std::string &input, const std::string &output,
+                bool compact) {
+  if (isBinaryNet(input)) {
+    JSONTools::writeTestFile(output, NetFile(input).toInputData(), compact);
+    return false;
+  }
+  writeBinaryNet(output, JSONTools::parseTestFile(input));
+  return true;
+}
+
+} // namespace NetFormat
@@ -0,0 +1,254 @@
+#include "NetGen.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+namespace NetGen {
+
+namespace {
+
+// mt19937_64 output is fixed by the standard, the mappings below make the
+// values portable too
+class Random {
+  std::mt19937_64 engine;
+
+public:
+  explicit Random(uint64_t seed) : engine(seed) {}
+
+  // [0, 1)
+  double unit() { return (engine() >> 11) * 0x1.0p-53; }
+  // [0, n)
+  int below(int n) { return std::min(int(unit() * n), n - 1); }
+  // [lo, hi]
+  int between(int lo, int hi) { return lo + below(hi - lo + 1); }
+  bool coin() { return engine() >> 63; }
+
+  // Box-Muller
+  double normal() {
+    double u = 1.0 - unit();
+    return std::sqrt(-2.0 * std::log(u)) *
+           std::cos(2.0 * std::numbers::pi * unit());
+  }
+
+  float sample(const Distribution &d) {
+    double value = d.kind == Distribution::Kind::Uniform
+                       ? d.a + (d.b - d.a) * unit()
+                       : d.a + d.b * normal();
+    // Three decimals keep the JSON readable
+    return float(std::round(value * 1000.0) / 1000.0);
+  }
+};
+
+using Point = std::pair<int, int>;
+
+class Builder {
+  const Options &options;
+  Random random;
+  JSONTools::InputData net;
+
+  int node(int x, int y, const char *type, const char *prefix) {
+    int id = net.nodes.size();
+    net.nodes.push_back({id, x, y, type, prefix + std::to_string(id)});
+    return id;
+  }
+
+  // Wire from parent to child, horizontal or vertical leg first
+  void connect(int parent, int child, bool horizontalFirst) {
+    const auto &from = net.nodes[parent];
+    const auto &to = net.nodes[child];
+    std::vector<std::vector<int>> points{{from.x, from.y}};
+    std::vector<int> corner = horizontalFirst ? std::vector<int>{to.x, from.y}
+                                              : std::vector<int>{from.x, to.y};
+    if (corner != points.front() && corner != std::vector<int>{to.x, to.y})
+      points.push_back(corner);
+    points.push_back({to.x, to.y});
+    net.edges.push_back({int(net.edges.size()), {parent, child}, points});
+  }
+
+  void connect(int parent, int child) {
+    connect(parent, child, random.coin());
+  }
+
+  int steiner(int x, int y) { return node(x, y, "s", "s"); }
+
+  int sink(int x, int y) {
+    int id = node(x, y, "t", "z");
+    // Negative loads make no sense, RATs may be anything
+    net.nodes[id].capacitance =
+        std::max(0.0f, random.sample(options.capacitance));
+    net.nodes[id].rat = random.sample(options.rat);
+    return id;
+  }
+
+  Point randomPoint() {
+    return {random.between(0, options.span), random.between(0, options.span)};
+  }
+
+  // Steiner point at the median of the group, the group is split along the
+  // longer side of its bounding box into up to fanout parts
+  void partition(int parent, std::vector<Point>::iterator begin,
+                 std::vector<Point>::iterator end) {
+    size_t count = end - begin;
+    if (count == 1) {
+      connect(parent, sink(begin->first, begin->second));
+      return;
+    }
+    auto [minX, maxX] = std::minmax_element(
+        begin, end, [](Point a, Point b) { return a.first < b.first; });
+    auto [minY, maxY] = std::minmax_element(
+        begin, end, [](Point a, Point b) { return a.second < b.second; });
+    bool alongX = maxX->first - minX->first >= maxY->second - minY->second;
+    // Ties are broken by the other coordinate, equal points are identical
+    // so the order never depends on the sort implementation
+    std::sort(begin, end, [alongX](Point a, Point b) {
+      return alongX ? a < b
+                    : std::tie(a.second, a.first) < std::tie(b.second, b.first);
+    });
+    std::vector<int> across;
+    for (auto it = begin; it != end; ++it)
+      across.push_back(alongX ? it->second : it->first);
+    std::nth_element(across.begin(), across.begin() + count / 2, across.end());
+    Point median = alongX ? Point{begin[count / 2].first, across[count / 2]}
+                          : Point{across[count / 2], begin[count / 2].second};
+
+    int id = steiner(median.first, median.second);
+    connect(parent, id);
+    size_t parts = std::min<size_t>(count, random.between(2, options.fanout));
+    auto first = begin;
+    for (size_t i = 0; i < parts; ++i) {
+      auto last = first + count / parts + (i < count % parts);
+      partition(id, first, last);
+      first = last;
+    }
+  }
+
+  void hTree(int parent, int x, int y, int level, int levels) {
+    if (level == levels) {
+      connect(parent, sink(x, y));
+      return;
+    }
+    int id = steiner(x, y);
+    connect(parent, id);
+    // Arms alternate horizontal and vertical and halve every two levels
+    int arm = options.span >> (2 + level / 2);
+    int dx = level % 2 ? 0 : arm;
+    int dy = level % 2 ? arm : 0;
+    hTree(id, x - dx, y - dy, level + 1, levels);
+    hTree(id, x + dx, y + dy, level + 1, levels);
+  }
+
+public:
+  Builder(const Options &options) : options(options), random(options.seed) {}
+
+  JSONTools::InputData build() {
+    int center = options.span / 2;
+    int driver = node(0, center, "b", "");
+    net.nodes[driver].name = options.driver;
+    switch (options.shape) {
+    case Shape::Steiner: {
+      std::vector<Point> points(options.sinks);
+      for (auto &point : points)
+        point = randomPoint();
+      partition(driver, points.begin(), points.end());
+      break;
+    }
+    case Shape::Chain: {
+      int pitch = std::max(1, options.span / options.sinks);
+      int previous = driver;
+      for (int i = 1; i <= options.sinks; ++i) {
+        int id = steiner(i * pitch, center);
+        connect(previous, id);
+        int stub = random.between(1, pitch);
+        connect(id, sink(i * pitch, center + (random.coin() ? stub : -stub)));
+        previous = id;
+      }
+      break;
+    }
+    case Shape::HTree: {
+      int levels = 0;
+      while ((1 << levels) < options.sinks)
+        ++levels;
+      hTree(driver, center, center, 0, levels);
+      break;
+    }
+    case Shape::Star: {
+      int hub = steiner(center, center);
+      connect(driver, hub);
+      for (int i = 0; i < options.sinks; ++i) {
+        auto [x, y] = randomPoint();
+        connect(hub, sink(x, y));
+      }
+      break;
+    }
+    }
+    return std::move(net);
+  }
+};
+
+float parseNumber(const std::string &text, const std::string &spec) {
+  try {
+    size_t used = 0;
+    float value = std::stof(text, &used);
+    if (used == text.size())
+      return value;
+  } catch (const std::exception &) {
+  }
+  throw std::runtime_error("Bad distribution " + spec);
+}
+
+} // namespace
+
+Distribution Distribution::parse(const std::string &spec) {
+  auto first = spec.find(':');
+  if (first == std::string::npos) {
+    float value = parseNumber(spec, spec);
+    return {Kind::Uniform, value, value};
+  }
+  auto second = spec.find(':', first + 1);
+  if (second == std::string::npos)
+    throw std::runtime_error("Bad distribution " + spec);
+  auto kind = spec.substr(0, first);
+  float a = parseNumber(spec.substr(first + 1, second - first - 1), spec);
+  float b = parseNumber(spec.substr(second + 1), spec);
+  if (kind == "uniform" && a <= b)
+    return {Kind::Uniform, a, b};
+  if (kind == "normal" && b >= 0.0f)
+    return {Kind::Normal, a, b};
+  throw std::runtime_error("Bad distribution " + spec);
+}
+
+Shape parseShape(const std::string &name) {
+  for (auto shape : {Shape::Steiner, Shape::Chain, Shape::HTree, Shape::Star})
+    if (name == shapeName(shape))
+      return shape;
+  throw std::runtime_error("Unknown net shape " + name);
+}
+
+const char *shapeName(Shape shape) {
+  switch (shape) {
+  case Shape::Steiner:
+    return "steiner";
+  case Shape::Chain:
+    return "chain";
+  case Shape::HTree:
+    return "htree";
+  case Shape::Star:
+    return "star";
+  }
+  return "unknown";
+}
+
+JSONTools::InputData generate(const Options &options) {
+  if (options.sinks < 1)
+    throw std::runtime_error("A net needs at least one sink");
+  if (options.span < 1)
+    throw std::runtime_error("The die span must be positive");
+  if (options.fanout < 2)
+    throw std::runtime_error("Steiner fanout must be at least 2");
+  return Builder(options).build();
+}
+
+} // namespace NetGen
@@ -0,0 +1,195 @@
+#include "NetOptimizer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace VG {
+
+namespace {
+
+int distance(const NetPoint &A, const NetPoint &B) {
+  return std::abs(A.X - B.X) + std::abs(A.Y - B.Y);
+}
+
+// Route of one edge from the parent to the child with the distance of every
+// point from the child
+class Route {
+  std::span<const NetPoint> Points;
+  std::vector<int> FromChild;
+
+public:
+  explicit Route(std::span<const NetPoint> Points)
+      : Points(Points), FromChild(Points.size(), 0) {
+    for (size_t I = Points.size() - 1; I-- > 0;)
+      FromChild[I] = FromChild[I + 1] + distance(Points[I], Points[I + 1]);
+  }
+
+  int length() const { return FromChild.front(); }
+
+  // Walks from the child like the output writer of the file flow: along a
+  // vertical segment Y moves, along any other one X
+  NetPoint at(int D) const {
+    for (size_t I = Points.size() - 1; I > 0; --I) {
+      if (D > FromChild[I - 1])
+        continue;
+      const auto &To = Points[I - 1];
+      const auto &From = Points[I];
+      int Rest = D - FromChild[I];
+      if (From.X == To.X)
+        return {From.X, From.Y + (To.Y > From.Y ? Rest : -Rest)};
+      return {From.X + (To.X > From.X ? Rest : -Rest), From.Y};
+    }
+    return Points.front();
+  }
+
+  // The route between two distances from the child, Far >= Near, from the
+  // far end
+  void between(int Far, int Near, std::vector<NetPoint> &Out) const {
+    Out.push_back(at(Far));
+    for (size_t I = 0; I < Points.size(); ++I)
+      if (FromChild[I] < Far && FromChild[I] > Near)
+        Out.push_back(Points[I]);
+    Out.push_back(at(Near));
+  }
+};
+
+} // namespace
+
+NetOptimizer::NetOptimizer(const TechParams &UnitWire,
+                           const BufferLibrary &Library, const Options &Opts)
+    : Engine(UnitWire, Library, Opts) {}
+
+BufferedNet NetOptimizer::optimize(const NetView &Net, int DriverCell) {
+  EngineID.clear();
+  Edges.clear();
+  Sinks.clear();
+
+  // Engine IDs as the file flow numbers them: the first driver, the sinks,
+  // then the Steiner points
+  auto Driver = std::find_if(Net.Nodes.begin(), Net.Nodes.end(),
+                             [](const NetNode &N) {
+                               return N.Kind == NodeKind::Driver;
+                             });
+  if (Driver == Net.Nodes.end())
+    throw std::runtime_error("Net has no driver");
+  EngineID.reserve(Net.Nodes.size());
+  EngineID.emplace(Driver->ID, 0);
+  int Next = 1;
+  for (auto Kind : {NodeKind::Sink, NodeKind::Steiner})
+    for (const auto &N : Net.Nodes) {
+      if (N.Kind != Kind)
+        continue;
+      if (!EngineID.emplace(N.ID, Next++).second)
+        throw std::runtime_error("Node ID " + std::to_string(N.ID) +
+                                 " is used twice");
+      if (Kind == NodeKind::Sink)
+        Sinks.push_back({N.C, N.RAT});
+    }
+
+  auto Known = [&](int ID) {
+    auto It = EngineID.find(ID);
+    if (It == EngineID.end())
+      throw std::runtime_error("Edge to unknown node " + std::to_string(ID));
+    return It->second;
+  };
+  // Every node but the driver is the child of exactly one edge. An edge
+  // given child first breaks that, and would leave EdgeOf pointing at the
+  // wrong edge.
+  EdgeOf.assign(Next, -1);
+  for (size_t I = 0; I < Net.Edges.size(); ++I) {
+    const auto &E = Net.Edges[I];
+    if (E.PointCount < 2 ||
+        size_t(E.FirstPoint) + E.PointCount > Net.Points.size())
+      throw std::runtime_error("Edge " + std::to_string(E.ID) +
+                               " has no valid route");
+    int Len = 0;
+    for (uint32_t P = E.FirstPoint + 1; P < E.FirstPoint + E.PointCount; ++P)
+      Len += distance(Net.Points[P - 1], Net.Points[P]);
+    auto &Wire = Edges.emplace_back();
+    Wire.Start = Known(E.From);
+    Wire.End = Known(E.To);
+    Wire.Len = Len;
+    if (Wire.End == 0 || EdgeOf[Wire.End] != -1)
+      throw std::runtime_error(
+          "Edge " + std::to_string(E.ID) + " runs against the net, node " +
+          std::to_string(E.To) +
+          (Wire.End == 0 ? " is the driver" : " already has a parent"));
+    EdgeOf[Wire.End] = I;
+  }
+  for (const auto &N : Net.Nodes)
+    if (N.Kind != NodeKind::Driver && EdgeOf[EngineID.at(N.ID)] == -1)
+      throw std::runtime_error("Node " + std::to_string(N.ID) +
+                               " has no edge from its parent");
+
+  Engine.setDriverCell(DriverCell);
+  Engine.buildRoutingTree(Edges, Sinks);
+  auto Best = Engine.getOptimParams();
+  BufferedNet Result;
+  Result.RAT = Best.RAT;
+  placeBuffers(Net, Best, Result);
+  return Result;
+}
+
+// IDs are given in the order of the file flow: edges by parent and child
+// ID, the buffers of an edge from the child, then the pieces from the
+// parent
+void NetOptimizer::placeBuffers(const NetView &Net, const Solution &Best,
+                                BufferedNet &Result) const {
+  int NextNode = 0;
+  for (const auto &N : Net.Nodes)
+    NextNode = std::max(NextNode, N.ID + 1);
+  int NextEdge = 0;
+  for (const auto &E : Net.Edges)
+    NextEdge = std::max(NextEdge, E.ID + 1);
+
+  std::vector<BufPlace> Placed;
+  for (const auto &B : Best.Buffers)
+    // The driver itself
+    if (B.ParentID != 0 || B.ChildID != 0)
+      Placed.push_back(B);
+  auto Key = [&](const BufPlace &B) {
+    const auto &E = Net.Edges[EdgeOf[B.ChildID]];
+    return std::tuple(E.From, E.To, B.Len);
+  };
+  std::stable_sort(Placed.begin(), Placed.end(),
+                   [&](const BufPlace &A, const BufPlace &B) {
+                     return Key(A) < Key(B);
+                   });
+
+  for (size_t First = 0; First < Placed.size();) {
+    auto Last = First;
+    int Index = EdgeOf[Placed[First].ChildID];
+    while (Last < Placed.size() && EdgeOf[Placed[Last].ChildID] == Index)
+      ++Last;
+    const auto &E = Net.Edges[Index];
+    Route Path(Net.Points.subspan(E.FirstPoint, E.PointCount));
+    Result.Split.push_back(E.ID);
+
+    auto Buffers = Result.Buffers.size();
+    for (auto I = First; I < Last; ++I)
+      Result.Buffers.push_back({NextNode++, Placed[I].Cell,
+                                Path.at(Placed[I].Len), E.ID,
+                                Placed[I].Len});
+    // Parent, buffers from the far end, child
+    int From = E.From;
+    int Far = Path.length();
+    for (auto I = Result.Buffers.size(); I-- > Buffers;) {
+      const auto &B = Result.Buffers[I];
+      auto Offset = Result.Points.size();
+      Path.between(Far, B.Distance, Result.Points);
+      Result.Pieces.push_back({NextEdge++, From, B.ID, uint32_t(Offset),
+                               uint32_t(Result.Points.size() - Offset)});
+      From = B.ID;
+      Far = B.Distance;
+    }
+    auto Offset = Result.Points.size();
+    Path.between(Far, 0, Result.Points);
+    Result.Pieces.push_back({NextEdge++, From, E.To, uint32_t(Offset),
+                             uint32_t(Result.Points.size() - Offset)});
+    First = Last;
+  }
+}
+
+} // namespace VG
@@ -0,0 +1,367 @@
+#include "Server.h"
+#include "JSONTools.h"
+#include "NetFormat.h"
+#include "NetOptimizer.h"
+#include "ThreadPool.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace Server {
+
+namespace {
+
+using json = nlohmann::json;
+
+// Larger frames are taken for a broken stream
+constexpr size_t MaxFrame = size_t(256) << 20;
+// Payloads grow as their bytes come in, so a header alone commits no memory
+constexpr size_t ReadChunk = size_t(1) << 20;
+
+bool readAll(int fd, char *data, size_t size) {
+  while (size) {
+    auto got = ::read(fd, data, size);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return false;
+    data += got;
+    size -= got;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const char *data, size_t size) {
+  while (size) {
+    auto put = ::write(fd, data, size);
+    if (put < 0 && errno == EINTR)
+      continue;
+    if (put <= 0)
+      return false;
+    data += put;
+    size -= put;
+  }
+  return true;
+}
+
+// False at the end of the stream, throws on a malformed header
+bool readFrame(int fd, std::string &payload) {
+  size_t size = 0;
+  int digits = 0;
+  char c;
+  while (true) {
+    if (!readAll(fd, &c, 1)) {
+      if (digits)
+        throw std::runtime_error("Stream ends inside a frame header");
+      return false;
+    }
+    if (c == '\n' && digits)
+      break;
+    if (c < '0' || c > '9' || ++digits > 10)
+      throw std::runtime_error("Malformed frame header");
+    size = size * 10 + (c - '0');
+  }
+  if (size > MaxFrame)
+    throw std::runtime_error("Frame of " + std::to_string(size) +
+                             " bytes is too large");
+  payload.clear();
+  while (payload.size() < size) {
+    auto done = payload.size();
+    auto chunk = std::min(size - done, ReadChunk);
+    payload.resize(done + chunk);
+    if (!readAll(fd, payload.data() + done, chunk))
+      throw std::runtime_error("Stream ends inside a frame");
+  }
+  return true;
+}
+
+// Replies of concurrent requests go out whole, one at a time
+class Replies {
+  int fd;
+  std::mutex lock;
+
+public:
+  explicit Replies(int fd) : fd(fd) {}
+
+  void send(const std::string &payload) {
+    auto header = std::to_string(payload.size()) + '\n';
+    std::lock_guard<std::mutex> guard(lock);
+    // A client that went away loses its replies, the server goes on
+    writeAll(fd, header.data(), header.size()) &&
+        writeAll(fd, payload.data(), payload.size());
+  }
+};
+
+// Engines keep their memory from request to request. A request borrows one
+// for its run, whichever thread serves it.
+class Engines {
+  const JSONTools::TechLibrary &tech;
+  std::mutex lock;
+  std::vector<std::unique_ptr<VG::NetOptimizer>> idle;
+
+public:
+  explicit Engines(const JSONTools::TechLibrary &tech) : tech(tech) {}
+
+  std::unique_ptr<VG::NetOptimizer> take() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (idle.empty())
+      return std::make_unique<VG::NetOptimizer>(tech.wire, tech.cells);
+    auto engine = std::move(idle.back());
+    idle.pop_back();
+    return engine;
+  }
+
+  void give(std::unique_ptr<VG::NetOptimizer> engine) {
+    std::lock_guard<std::mutex> guard(lock);
+    idle.push_back(std::move(engine));
+  }
+};
+
+// Binary nets are optimized in place from the mapping. Fills rat and
+// buffers of the reply and returns the buffered net if asked for.
+std::string optimizeMapped(const std::string &filename,
+                           VG::NetOptimizer &optimizer,
+                           const JSONTools::TechLibrary &tech, bool topology,
+                           json &reply) {
+  NetFormat::NetFile net(filename);
+  auto result = optimizer.optimize(net.view(), net.driverCell(tech.cellNames));
+  reply["rat"] = result.RAT;
+  auto &buffers = reply["buffers"] = json::array();
+  for (const auto &buffer : result.Buffers)
+    buffers.push_back(
+        {{"id", buffer.ID},
+         {"name", NetFormat::bufferName(net, buffer, tech.cellNames)},
+         {"x", buffer.At.X},
+         {"y", buffer.At.Y}});
+  if (!topology)
+    return {};
+  return NetFormat::bufferedNet(net, result, tech.cellNames, true).text();
+}
+
+// JSON nets go through the editable form and the engine's structures
+std::string optimizeParsed(JSONTools::InputData &inputData,
+                           VG::NetOptimizer &optimizer,
+                           const JSONTools::TechLibrary &tech, bool topology,
+                           json &reply) {
+  std::vector<VG::Edge> edges;
+  std::vector<VG::Node> nodes;
+  std::map<int, int> originalToNewId, newToOriginalId;
+  JSONTools::convertToVGStructures(inputData, edges, nodes, originalToNewId,
+                                   newToOriginalId);
+  auto &engine = optimizer.engine();
+  engine.setDriverCell(JSONTools::findDriverCell(inputData, tech.cellNames));
+  engine.buildRoutingTree(edges, nodes);
+  auto solution = engine.getOptimParams();
+
+  auto net = JSONTools::bufferedNet(inputData, solution.Buffers,
+                                    newToOriginalId, tech.cellNames);
+  reply["rat"] = solution.RAT;
+  auto &buffers = reply["buffers"] = json::array();
+  for (size_t i = inputData.nodes.size(); i < net.nodes.size(); ++i) {
+    const auto &node = net.nodes[i];
+    buffers.push_back(
+        {{"id", node.id}, {"name", node.name}, {"x", node.x}, {"y", node.y}});
+  }
+  if (!topology)
+    return {};
+  return JSONTools::writeTestText(net, true);
+}
+
+std::string handle(const std::string &payload, Engines &engines,
+                   const JSONTools::TechLibrary &tech) {
+  using namespace std::chrono;
+  auto start = steady_clock::now();
+  json reply;
+  try {
+    auto request = json::parse(payload);
+    if (!request.is_object())
+      throw std::runtime_error("Request must be a JSON object");
+    if (request.contains("id"))
+      reply["id"] = request["id"];
+
+    std::string filename;
+    bool mapped = false;
+    JSONTools::InputData inputData;
+    if (request.contains("net"))
+      inputData = JSONTools::parseTestText(request["net"].dump(), "request");
+    else if (request.contains("file")) {
+      filename = request["file"].get<std::string>();
+      mapped = NetFormat::isBinaryNet(filename);
+      if (!mapped)
+        inputData = JSONTools::parseTestFile(filename);
+    } else
+      throw std::runtime_error("Request has neither net nor file");
+    bool topology = request.value("topology", false);
+
+    auto engine = engines.take();
+    std::string net;
+    try {
+      net = mapped ? optimizeMapped(filename, *engine, tech, topology, reply)
+                   : optimizeParsed(inputData, *engine, tech, topology, reply);
+    } catch (...) {
+      engines.give(std::move(engine));
+      throw;
+    }
+    engines.give(std::move(engine));
+
+    reply["ok"] = true;
+    reply["ms"] =
+        duration<double, std::milli>(steady_clock::now() - start).count();
+    if (topology) {
+      // The net goes in as written by the net writer, not through a DOM
+      auto text = reply.dump();
+      text.pop_back();
+      text += ",\"net\":";
+      text += net;
+      while (text.back() == '\n')
+        text.pop_back();
+      return text + '}';
+    }
+  } catch (const std::exception &e) {
+    // Nothing of a partial result goes out
+    json error;
+    if (reply.contains("id"))
+      error["id"] = reply["id"];
+    error["ok"] = false;
+    error["error"] = e.what();
+    return error.dump();
+  }
+  return reply.dump();
+}
+
+// Reads frames until the stream ends and runs them on the pool. Returns
+// when every reply is sent.
+void serveFrames(int in, int out, VG::ThreadPool &pool, Engines &engines,
+                 const JSONTools::TechLibrary &tech) {
+  Replies replies(out);
+  VG::TaskGroup group(pool);
+  std::string payload;
+  try {
+    while (readFrame(in, payload))
+      group.run([&, payload = std::move(payload)] {
+        replies.send(handle(payload, engines, tech));
+      });
+  } catch (const std::exception &e) {
+    // The frames that follow cannot be found again
+    replies.send(json{{"ok", false}, {"error", e.what()}}.dump());
+  }
+  group.wait();
+}
+
+// Connections being served, each on its own thread. The server waits for
+// them before the pool and the engines they use go away.
+class Clients {
+  std::mutex lock;
+  std::condition_variable done;
+  std::vector<int> open;
+
+  void hangUp(int fd) {
+    std::lock_guard<std::mutex> guard(lock);
+    ::close(fd);
+    open.erase(std::find(open.begin(), open.end(), fd));
+    done.notify_all();
+  }
+
+public:
+  ~Clients() {
+    std::unique_lock<std::mutex> guard(lock);
+    // Clients stop reading, answer what they have and hang up
+    for (int fd : open)
+      ::shutdown(fd, SHUT_RD);
+    done.wait(guard, [&] { return open.empty(); });
+  }
+
+  void serve(int fd, VG::ThreadPool &pool, Engines &engines,
+             const JSONTools::TechLibrary &tech) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      open.push_back(fd);
+    }
+    try {
+      std::thread([this, fd, &pool, &engines, &tech] {
+        serveFrames(fd, fd, pool, engines, tech);
+        hangUp(fd);
+      }).detach();
+    } catch (...) {
+      hangUp(fd);
+      throw;
+    }
+  }
+};
+
+} // namespace
+
+void serveStream(int in, int out, const JSONTools::TechLibrary &tech,
+                 unsigned threads) {
+  VG::ThreadPool pool(std::max(1u, threads));
+  Engines engines(tech);
+  serveFrames(in, out, pool, engines, tech);
+}
+
+void serveStdio(const JSONTools::TechLibrary &tech, unsigned threads) {
+  serveStream(STDIN_FILENO, STDOUT_FILENO, tech, threads);
+}
+
+void serveSocket(const std::string &path, const JSONTools::TechLibrary &tech,
+                 unsigned threads) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Socket path is too long: " + path);
+  std::strcpy(address.sun_path, path.c_str());
+
+  // A socket file left by an earlier server is replaced, anything else at
+  // the path is the user's and stays
+  struct stat existing;
+  if (::lstat(path.c_str(), &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode))
+      throw std::runtime_error(path + " exists and is not a socket");
+    ::unlink(path.c_str());
+  }
+
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0)
+    throw std::runtime_error("Could not create socket: " +
+                             std::string(std::strerror(errno)));
+  // Clients make the server read files as this user, so only this user
+  // may connect. Nobody can before listen().
+  if (::bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0 ||
+      ::chmod(path.c_str(), 0600) < 0 ||
+      ::listen(listener, SOMAXCONN) < 0) {
+    auto error = std::string(std::strerror(errno));
+    ::close(listener);
+    throw std::runtime_error("Could not listen on " + path + ": " + error);
+  }
+  // Replies to a client that closed its end fail instead of killing us
+  std::signal(SIGPIPE, SIG_IGN);
+
+  VG::ThreadPool pool(std::max(1u, threads));
+  Engines engines(tech);
+  // Declared last, so it waits for the clients before anything else goes
+  Clients clients;
+  while (true) {
+    int client = ::accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      auto error = std::string(std::strerror(errno));
+      ::close(listener);
+      throw std::runtime_error("Could not accept on " + path + ": " + error);
+    }
+    clients.serve(client, pool, engines, tech);
+  }
+}
+
+} // namespace Server
@@ -0,0 +1,207 @@
+#include "TechLibrary.h"
+#include "JSONTools.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace JSONTools {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Layout, native byte order:
+//   "VGTL" u32 version  u64 source hash
+//   f32 wire C, R, delay  u32 cell count
+//   per cell: f32 C, R, delay  u32 name length  name bytes
+constexpr char Magic[4] = {'V', 'G', 'T', 'L'};
+constexpr uint32_t Version = 1;
+constexpr size_t CellBytes = 3 * sizeof(float) + sizeof(uint32_t);
+
+std::string readFile(const std::string &filename, const char *what) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open())
+    throw std::runtime_error(std::string("Could not open ") + what + ": " +
+                             filename);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+template <typename T> void put(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void putParams(std::string &out, const VG::TechParams &params) {
+  put(out, params.C);
+  put(out, params.R);
+  put(out, params.IntrinsicDel);
+}
+
+// Bounds-checked reads over the cache contents
+class Cursor {
+  const std::string &bytes;
+  size_t pos = 0;
+
+public:
+  explicit Cursor(const std::string &bytes) : bytes(bytes) {}
+
+  template <typename T> bool get(T &value) {
+    if (bytes.size() - pos < sizeof(T))
+      return false;
+    std::memcpy(&value, bytes.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+  bool getParams(VG::TechParams &params) {
+    return get(params.C) && get(params.R) && get(params.IntrinsicDel);
+  }
+  bool getString(std::string &value, uint32_t length) {
+    if (bytes.size() - pos < length)
+      return false;
+    value.assign(bytes, pos, length);
+    pos += length;
+    return true;
+  }
+  size_t remaining() const { return bytes.size() - pos; }
+  bool atEnd() const { return pos == bytes.size(); }
+};
+
+// $VG_CACHE_DIR, or a directory of our own under the user's cache
+// directory. Never a shared one like /tmp, where other users could plant
+// or redirect cache files. An empty $VG_CACHE_DIR turns the cache off.
+fs::path cacheDirectory() {
+  if (const char *dir = std::getenv("VG_CACHE_DIR"))
+    return dir;
+  if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && *dir)
+    return fs::path(dir) / "vlsiproject";
+  if (const char *home = std::getenv("HOME"); home && *home)
+    return fs::path(home) / ".cache" / "vlsiproject";
+  return {};
+}
+
+bool writeFd(int fd, const std::string &out) {
+  for (size_t done = 0; done < out.size();) {
+    auto put = ::write(fd, out.data() + done, out.size() - done);
+    if (put < 0 && errno == EINTR)
+      continue;
+    if (put <= 0)
+      return false;
+    done += put;
+  }
+  return true;
+}
+
+} // namespace
+
+uint64_t hashBytes(const std::string &bytes) {
+  uint64_t hash = 1469598103934665603ull;
+  for (unsigned char byte : bytes) {
+    hash ^= byte;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string techCachePath(uint64_t sourceHash) {
+  auto base = cacheDirectory();
+  if (base.empty())
+    return {};
+  char name[32];
+  std::snprintf(name, sizeof(name), "vg-tech-%016llx.bin",
+                static_cast<unsigned long long>(sourceHash));
+  return (base / name).string();
+}
+
+TechLibrary TechLibrary::parse(const std::string &filename) {
+  TechLibrary tech;
+  parseTechnology(filename, tech.wire, tech.cells, tech.cellNames);
+  return tech;
+}
+
+TechLibrary TechLibrary::load(const std::string &filename) {
+  auto text = readFile(filename, "tech file");
+  auto hash = hashBytes(text);
+  auto cacheFile = techCachePath(hash);
+
+  TechLibrary tech;
+  if (!cacheFile.empty() && tech.readCache(cacheFile, hash))
+    return tech;
+  parseTechnologyText(text, filename, tech.wire, tech.cells, tech.cellNames);
+  if (!cacheFile.empty())
+    tech.writeCache(cacheFile, hash);
+  return tech;
+}
+
+void TechLibrary::writeCache(const std::string &cacheFile,
+                             uint64_t sourceHash) const {
+  std::string out(Magic, sizeof(Magic));
+  put(out, Version);
+  put(out, sourceHash);
+  putParams(out, wire);
+  put(out, uint32_t(cells.size()));
+  for (size_t i = 0; i < cells.size(); ++i) {
+    putParams(out, cells[i]);
+    const auto &name = i < cellNames.size() ? cellNames[i] : std::string();
+    put(out, uint32_t(name.size()));
+    out += name;
+  }
+
+  // A directory we create is private to the user
+  std::error_code ec;
+  auto dir = fs::path(cacheFile).parent_path();
+  fs::create_directories(dir.parent_path(), ec);
+  ::mkdir(dir.c_str(), 0700);
+
+  // Written aside to a fresh file and renamed, so concurrent runs never see
+  // half a cache and nothing already there is written through
+  auto temp = cacheFile + ".XXXXXX";
+  int fd = ::mkstemp(temp.data());
+  if (fd < 0)
+    return;
+  bool written = writeFd(fd, out);
+  if (::close(fd) != 0)
+    written = false;
+  if (written)
+    fs::rename(temp, cacheFile, ec);
+  if (!written || ec)
+    fs::remove(temp, ec);
+}
+
+bool TechLibrary::readCache(const std::string &cacheFile,
+                            uint64_t sourceHash) {
+  std::string bytes;
+  try {
+    bytes = readFile(cacheFile, "tech cache");
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+
+  Cursor in(bytes);
+  char magic[sizeof(Magic)];
+  uint32_t version, count;
+  uint64_t hash;
+  if (!in.get(magic) || std::memcmp(magic, Magic, sizeof(Magic)) != 0 ||
+      !in.get(version) || version != Version || !in.get(hash) ||
+      hash != sourceHash || !in.getParams(wire) || !in.get(count) ||
+      count > in.remaining() / CellBytes)
+    return false;
+
+  cells.assign(count, {});
+  cellNames.assign(count, {});
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t length;
+    if (!in.getParams(cells[i]) || !in.get(length) ||
+        !in.getString(cellNames[i], length))
+      return false;
+  }
+  return in.atEnd() && count > 0;
+}
+
+} // namespace JSONTools
@@ -0,0 +1,123 @@
+#include "ThreadPool.h"
+#include <utility>
+
+namespace VG {
+
+namespace {
+thread_local const ThreadPool *CurrentPool = nullptr;
+thread_local int CurrentIdx = -1;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned Threads) {
+  for (unsigned I = 0; I <= Threads; ++I)
+    Queues.push_back(std::make_unique<Queue>());
+  for (unsigned I = 0; I < Threads; ++I)
+    Workers.emplace_back([this, I] { workerLoop(I); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> Guard(SleepLock);
+    Stop = true;
+  }
+  Wake.notify_all();
+  for (auto &Worker : Workers)
+    Worker.join();
+}
+
+int ThreadPool::currentWorker() const {
+  return CurrentPool == this ? CurrentIdx : -1;
+}
+
+void ThreadPool::submit(std::function<void()> Task) {
+  auto Self = currentWorker();
+  auto &Target = *Queues[Self < 0 ? Workers.size() : Self];
+  {
+    std::lock_guard<std::mutex> Guard(Target.Lock);
+    Target.Tasks.push_back(std::move(Task));
+  }
+  Queued.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> Guard(SleepLock);
+  }
+  Wake.notify_one();
+}
+
+bool ThreadPool::tryRun(int Self) {
+  if (Queued.load() == 0)
+    return false;
+
+  std::function<void()> Task;
+  // Own queue first (newest task, its data is still in cache), then steal
+  // the oldest task of the others
+  if (Self >= 0) {
+    auto &Own = *Queues[Self];
+    std::lock_guard<std::mutex> Guard(Own.Lock);
+    if (!Own.Tasks.empty()) {
+      Task = std::move(Own.Tasks.back());
+      Own.Tasks.pop_back();
+    }
+  }
+  size_t Start = Self < 0 ? Workers.size() : Self;
+  for (size_t I = 1; !Task && I <= Queues.size(); ++I) {
+    auto &Victim = *Queues[(Start + I) % Queues.size()];
+    std::lock_guard<std::mutex> Guard(Victim.Lock);
+    if (!Victim.Tasks.empty()) {
+      Task = std::move(Victim.Tasks.front());
+      Victim.Tasks.pop_front();
+    }
+  }
+  if (!Task)
+    return false;
+
+  Queued.fetch_sub(1);
+  Task();
+  return true;
+}
+
+void ThreadPool::workerLoop(int Self) {
+  CurrentPool = this;
+  CurrentIdx = Self;
+  while (true) {
+    if (tryRun(Self))
+      continue;
+    std::unique_lock<std::mutex> Guard(SleepLock);
+    Wake.wait(Guard, [this] { return Stop || Queued.load() > 0; });
+    if (Stop)
+      return;
+  }
+}
+
+void TaskGroup::run(std::function<void()> Task) {
+  Pending.fetch_add(1);
+  Pool.submit([this, Task = std::move(Task)] {
+    try {
+      Task();
+    } catch (...) {
+      std::lock_guard<std::mutex> Guard(ErrorLock);
+      if (!Error)
+        Error = std::current_exception();
+    }
+    // Under the lock, so the group outlives the notification
+    std::lock_guard<std::mutex> Guard(DoneLock);
+    if (Pending.fetch_sub(1) == 1)
+      Done.notify_all();
+  });
+}
+
+// With nothing left to steal, every pending task of the group is running on
+// some other thread
+void TaskGroup::join() {
+  while (Pending.load() > 0 && Pool.runOne())
+    ;
+  std::unique_lock<std::mutex> Guard(DoneLock);
+  Done.wait(Guard, [this] { return Pending.load() == 0; });
+}
+
+void TaskGroup::wait() {
+  join();
+  if (Error)
+    std::rethrow_exception(std::exchange(Error, nullptr));
+}
+
+} // namespace VG
@@ -1,58 +1,294 @@
+#include "Batch.h"
 #include "BufferInsertVG.h"
 #include "JSONTools.h"
+#include "NetFormat.h"
+#include "NetOptimizer.h"
+#include "Server.h"
+#include "TechLibrary.h"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 // #define DEBUG
 
 int main(int argc, char* argv[]) {
   using namespace std::chrono;
-  if (argc < 3) {
+  VG::Options options;
+  bool batch = false;
+  bool serve = false;
+  bool convert = false;
+  bool compact = false;
+  bool memStats = false;
+  bool readStats = false;
+  std::string profilePrefix;
+  std::string ecoFilename;
+  std::string siteFilename;
+  int sitePitch = 0;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--batch")
+      batch = true;
+    else if (arg == "--serve")
+      serve = true;
+    else if (arg == "--convert")
+      convert = true;
+    else if (arg == "--compact")
+      compact = true;
+    else if (arg == "--mem-stats")
+      memStats = true;
+    else if (arg == "--read-stats")
+      readStats = true;
+    else if (arg == "--checked-merge")
+      options.CheckedMerge = true;
+    else if (arg == "--check-invariants")
+      options.CheckInvariants = true;
+    else if (arg == "--fast-wires")
+      options.FastWires = true;
+    else if (arg == "--threads" && i + 1 < argc)
+      options.Threads = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--profile" && i + 1 < argc)
+      profilePrefix = argv[++i];
+    else if (arg == "--eco" && i + 1 < argc)
+      ecoFilename = argv[++i];
+    else if (arg == "--epsilon" && i + 1 < argc)
+      options.Epsilon = std::atof(argv[++i]);
+    else if (arg == "--site-pitch" && i + 1 < argc)
+      sitePitch = std::atoi(argv[++i]);
+    else if (arg == "--sites" && i + 1 < argc)
+      siteFilename = argv[++i];
+    else
+      positional.push_back(arg);
+  }
+
+  if (serve && !positional.empty()) {
+    try {
+      auto tech = JSONTools::TechLibrary::load(positional[0]);
+      if (positional.size() > 1)
+        Server::serveSocket(positional[1], tech, options.Threads);
+      else
+        Server::serveStdio(tech, options.Threads);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (positional.size() < 2) {
     std::cerr << "Usage: " << argv[0]
-              << " <technology_file>.json <test_file>.json" << std::endl;
+              << " [--checked-merge] [--check-invariants] [--threads N] "
+                 "[--compact] [--fast-wires] "
+                 "[--profile PREFIX] [--mem-stats] [--read-stats] "
+                 "[--eco <delta>.json] "
+                 "[--epsilon E] [--site-pitch N] [--sites <sites>.json] "
+                 "<technology_file>.json <test_file>.json"
+              << std::endl
+              << "       " << argv[0]
+              << " --batch [--threads N] [--compact] [--mem-stats] "
+                 "[--checked-merge] [--check-invariants] [--fast-wires] "
+                 "[--epsilon E] [--site-pitch N] <technology_file>.json "
+                 "<manifest | directory>"
+              << std::endl
+              << "       " << argv[0]
+              << " --serve [--threads N] <technology_file>.json [socket]"
+              << std::endl
+              << "       " << argv[0]
+              << " --convert <net>.json <net>.vgnet | <net>.vgnet <net>.json"
+              << std::endl;
     return 1;
   }
 
-    std::string techFilename = argv[1];
-    std::string testFilename = argv[2];
+    if (convert) {
+        try {
+            bool binary =
+                NetFormat::convertNet(positional[0], positional[1], compact);
+            std::cout << "Converted " << positional[0] << " to "
+                      << (binary ? "binary" : "JSON") << " net "
+                      << positional[1] << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::string techFilename = positional[0];
+    std::string testFilename = positional[1];
     
     try {
-        VG::TechParams wireParams = JSONTools::parseTechFile(techFilename);
-        VG::TechParams bufferParams = JSONTools::parseBufferParams(techFilename);
-        JSONTools::InputData inputData = JSONTools::parseTestFile(testFilename);
+        auto tech = JSONTools::TechLibrary::load(techFilename);
+        const auto &wireParams = tech.wire;
+        const auto &library = tech.cells;
+        const auto &cellNames = tech.cellNames;
+        if (options.FastWires &&
+            !VG::BufferInsertVG::fastWires(wireParams, library))
+            std::cerr << "Warning: --fast-wires needs a library with a single "
+                         "useful buffer cell and a wire with resistance and "
+                         "cap, every wire is searched exactly" << std::endl;
+        if (batch) {
+            // Those belong to a single net
+            if (!profilePrefix.empty() || !ecoFilename.empty() ||
+                !siteFilename.empty())
+                throw std::runtime_error(
+                    "--profile, --eco and --sites take a single net, not "
+                    "--batch");
+            if (sitePitch)
+                options.SitePitch = sitePitch;
+            auto nets = Batch::collectNets(testFilename, techFilename);
+            auto results = Batch::run(nets, wireParams, library, cellNames,
+                                      options, compact);
+            Batch::writeSummary(std::cout, results);
+            auto failed = std::count_if(results.begin(), results.end(),
+                                        [](const auto &r) { return !r.ok; });
+            std::cerr << "Batch complete: " << results.size() << " nets, "
+                      << failed << " failed" << std::endl;
+            if (memStats)
+                VG::MemStats::report().print(std::cerr);
+            return failed ? 1 : 0;
+        }
+
+        // --eco and --sites edit the net, those work on an editable copy.
+        // Other binary nets are optimized in place from the mapping.
+        bool mapped = NetFormat::isBinaryNet(testFilename) &&
+                      ecoFilename.empty() && siteFilename.empty();
+        auto parseStart = high_resolution_clock::now();
+        std::unique_ptr<NetFormat::NetFile> net;
+        JSONTools::InputData inputData;
+        if (mapped)
+            net = std::make_unique<NetFormat::NetFile>(testFilename);
+        else
+            inputData = NetFormat::readNet(testFilename);
+        if (readStats) {
+            auto parseSeconds =
+                duration<double>(high_resolution_clock::now() - parseStart)
+                    .count();
+            auto megabytes = std::filesystem::file_size(testFilename) / 1e6;
+            std::cerr << (mapped ? "Mapped " : "Parsed ") << megabytes
+                      << " MB in " << parseSeconds << " s ("
+                      << megabytes / parseSeconds << " MB/s)" << std::endl;
+        }
         
         std::vector<VG::Edge> edges;
         std::vector<VG::Node> nodes;
         std::map<int, int> originalToNewId, newToOriginalId;
-        JSONTools::convertToVGStructures(inputData, edges, nodes, originalToNewId, newToOriginalId);
+        if (!mapped) {
+            JSONTools::convertToVGStructures(inputData, edges, nodes, originalToNewId, newToOriginalId);
 #ifdef DEBUG
-        std::cout << "Edges\n";
-        for (const auto& elem: edges) 
-            std::cout << elem.Start << " | " << elem.End << " | " << elem.Len << std::endl;
-        std::cout << std::endl << "Sinks:\n";
-        for (const auto& elem: nodes)
-          std::cout << elem.ParentID << " | " << elem.CapsRATs.begin()->C
-                    << " | " << elem.CapsRATs.begin()->RAT << std::endl;
+            std::cout << "Edges\n";
+            for (const auto& elem: edges) 
+                std::cout << elem.Start << " | " << elem.End << " | " << elem.Len << std::endl;
+            std::cout << std::endl << "Sinks:\n";
+            for (const auto& elem: nodes)
+              std::cout << elem.ID << " | " << elem.CapsRATs.at(0).C
+                        << " | " << elem.CapsRATs.at(0).RAT << std::endl;
 #endif
-        VG::BufferInsertVG bufferInserter(wireParams, bufferParams);
-        bufferInserter.buildRoutingTree(edges, nodes);
+            options.DriverCell = JSONTools::findDriverCell(inputData, cellNames);
+        } else {
+            options.DriverCell = net->driverCell(cellNames);
+        }
+        if (!siteFilename.empty()) {
+            auto sites = JSONTools::parseSiteFile(siteFilename);
+            JSONTools::applySiteMap(sites, inputData, edges, originalToNewId);
+            if (sites.pitch)
+                options.SitePitch = sites.pitch;
+        }
+        if (sitePitch)
+            options.SitePitch = sitePitch;
+        options.Profile = !profilePrefix.empty();
+        options.Incremental = !ecoFilename.empty();
+        VG::NetOptimizer optimizer(wireParams, library, options);
+        auto &bufferInserter = optimizer.engine();
 
-        auto Start = high_resolution_clock::now();
-        const auto &optimalParams = bufferInserter.getOptimParams();
-        auto End = high_resolution_clock::now();
+        float rat;
+        high_resolution_clock::time_point Start, End;
+        if (mapped) {
+            Start = high_resolution_clock::now();
+            auto buffered =
+                optimizer.optimize(net->view(), options.DriverCell);
+            End = high_resolution_clock::now();
+            NetFormat::writeOutputFile(testFilename, *net, buffered, true,
+                                       cellNames, compact);
+            rat = buffered.RAT;
+        } else {
+            bufferInserter.buildRoutingTree(edges, nodes);
 
-        const auto &bufferLocations = optimalParams.Buffers;
+            Start = high_resolution_clock::now();
+            auto optimalParams = bufferInserter.getOptimParams();
+            End = high_resolution_clock::now();
 
-        JSONTools::writeOutputFile(testFilename, inputData, bufferLocations, newToOriginalId);
+            if (!ecoFilename.empty()) {
+                auto steps = JSONTools::parseDeltaFile(ecoFilename);
+                std::cout << "Initial RAT: "
+                          << std::round(optimalParams.RAT * 100) / 100 << " ("
+                          << duration<double, std::milli>(End - Start).count()
+                          << " ms)" << std::endl;
+                for (size_t step = 0; step < steps.size(); ++step) {
+                    auto changes = JSONTools::applyDelta(
+                        inputData, steps[step], originalToNewId);
+                    auto stepStart = high_resolution_clock::now();
+                    optimalParams = bufferInserter.update(changes);
+                    auto stepEnd = high_resolution_clock::now();
+                    std::cout << "ECO step " << step + 1 << ": RAT "
+                              << std::round(optimalParams.RAT * 100) / 100
+                              << " ("
+                              << duration<double, std::milli>(stepEnd -
+                                                              stepStart)
+                                     .count()
+                              << " ms)" << std::endl;
+                }
+            }
+
+            const auto &bufferLocations = optimalParams.Buffers;
+
+            JSONTools::writeOutputFile(testFilename, inputData,
+                                       bufferLocations, newToOriginalId, true,
+                                       cellNames, compact);
+            rat = optimalParams.RAT;
+        }
 
         std::cout << "Optimization complete. Optimal RAT: "
-                  << std::round(optimalParams.RAT * 100) / 100 << std::endl;
+                  << std::round(rat * 100) / 100 << std::endl;
+        if (options.Epsilon > 0) {
+            auto stats = bufferInserter.pruneStats();
+            std::cout << "Approximate pruning, epsilon " << stats.Epsilon
+                      << ": RAT at most " << stats.RATBound
+                      << " below optimal, " << stats.Thinned
+                      << " candidates merged, lists up to "
+                      << stats.LongestList << " (mean "
+                      << (stats.Prunes ? double(stats.TotalLength) /
+                                             stats.Prunes
+                                       : 0.0)
+                      << ")" << std::endl;
+        }
+        if (const auto *profile = bufferInserter.profile()) {
+            std::ofstream trace(profilePrefix + ".trace.json");
+            profile->writeChromeTrace(trace);
+            std::ofstream csv(profilePrefix + ".csv");
+            profile->writeCSV(csv);
+            if (!trace || !csv)
+                throw std::runtime_error("Could not write profile " +
+                                         profilePrefix);
+            std::cout << "Profile written to " << profilePrefix
+                      << ".trace.json and " << profilePrefix << ".csv"
+                      << std::endl;
+        }
+        if (memStats)
+            VG::MemStats::report().print(std::cerr);
 #ifdef DEBUG
         std::cout << "Time: "
                   << duration_cast<milliseconds>(End - Start).count()
                   << std::endl;
+        std::cout << "Tree memory peak: "
+                  << bufferInserter.peakTreeBytes() / 1024 << " KB"
+                  << std::endl;
 #endif
 
     } catch (const std::exception& e) {
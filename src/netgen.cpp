@@ -0,0 +1,73 @@
+#include "JSONTools.h"
+#include "NetFormat.h"
+#include "NetGen.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void usage(const char *program) {
+  std::cerr
+      << "Usage: " << program
+      << " [--shape steiner|chain|htree|star] [--sinks N] [--span L]\n"
+         "       [--fanout K] [--seed S] [--cap DIST] [--rat DIST]\n"
+         "       [--driver CELL] [--compact] <net>.json | <net>.vgnet\n"
+         "DIST is uniform:LO:HI, normal:MEAN:SD or a constant\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  NetGen::Options options;
+  bool compact = false;
+  std::string output;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (arg == "--compact")
+        compact = true;
+      else if (arg == "--shape" && hasValue)
+        options.shape = NetGen::parseShape(argv[++i]);
+      else if (arg == "--sinks" && hasValue)
+        options.sinks = std::atoi(argv[++i]);
+      else if (arg == "--span" && hasValue)
+        options.span = std::atoi(argv[++i]);
+      else if (arg == "--fanout" && hasValue)
+        options.fanout = std::atoi(argv[++i]);
+      else if (arg == "--seed" && hasValue)
+        options.seed = std::strtoull(argv[++i], nullptr, 10);
+      else if (arg == "--cap" && hasValue)
+        options.capacitance = NetGen::Distribution::parse(argv[++i]);
+      else if (arg == "--rat" && hasValue)
+        options.rat = NetGen::Distribution::parse(argv[++i]);
+      else if (arg == "--driver" && hasValue)
+        options.driver = argv[++i];
+      else if (output.empty() && arg[0] != '-')
+        output = arg;
+      else {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    if (output.empty()) {
+      usage(argv[0]);
+      return 1;
+    }
+
+    auto net = NetGen::generate(options);
+    if (std::filesystem::path(output).extension() == ".vgnet")
+      NetFormat::writeBinaryNet(output, net);
+    else
+      JSONTools::writeTestFile(output, net, compact);
+    std::cout << "Generated " << NetGen::shapeName(options.shape) << " net "
+              << output << ": " << net.nodes.size() << " nodes, "
+              << net.edges.size() << " edges" << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
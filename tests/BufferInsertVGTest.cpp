@@ -0,0 +1,402 @@
+#include "BufferInsertVG.h"
+#include "NetOptimizer.h"
+#include "TestNets.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+using namespace TestNets;
+
+// Profiled runs record every node and give the same answer
+TEST(BufferInsertVGTest, Profile) {
+  auto input = generatedNet(testNet(50));
+
+  VG::BufferInsertVG plain(kWire, kLibrary);
+  plain.buildRoutingTree(input.edges, input.sinks);
+  EXPECT_EQ(plain.profile(), nullptr);
+  VG::Options options;
+  options.Profile = true;
+  options.Threads = 2;
+  VG::BufferInsertVG profiled(kWire, kLibrary, options);
+  profiled.buildRoutingTree(input.edges, input.sinks);
+  EXPECT_EQ(plain.getOptimParams().RAT, profiled.getOptimParams().RAT);
+
+  auto nodes = profiled.profile()->nodes();
+  ASSERT_EQ(nodes.size(), input.net.nodes.size());
+  for (const auto &node : nodes) {
+    EXPECT_LE(node.Start, node.MergeEnd);
+    EXPECT_LE(node.MergeEnd, node.End);
+    EXPECT_GE(node.PeakLength, node.Surviving);
+    // A sink only adds buffered candidates to its own one
+    if (node.Children == 0) {
+      EXPECT_EQ(node.Created, node.Pruned + node.Surviving);
+    }
+  }
+
+  std::stringstream csv, trace;
+  profiled.profile()->writeCSV(csv);
+  profiled.profile()->writeChromeTrace(trace);
+  EXPECT_EQ(std::count(std::istreambuf_iterator<char>(csv),
+                       std::istreambuf_iterator<char>(), '\n'),
+            nodes.size() + 1);
+  EXPECT_NE(trace.str().find("\"traceEvents\""), std::string::npos);
+}
+
+// With the same driver a library does at least as well as any of its cells
+// alone, and a cell that another one beats in every parameter is never
+// placed
+TEST(BufferInsertVGTest, CellLibrary) {
+  auto input = generatedNet(testNet(60));
+  // Cell 2 is worse than cell 0 in cap, drive and delay
+  auto library = kLibrary;
+  library.push_back({1.0f, 2.5f, 6.0f});
+  for (int driver = 0; driver < int(kLibrary.size()); ++driver) {
+    SCOPED_TRACE(driver);
+    VG::Options options;
+    options.DriverCell = driver;
+    auto result = optimize(input, options, library);
+    EXPECT_EQ(result.RAT, optimize(input, options).RAT);
+    EXPECT_GE(result.RAT, optimize(input, {}, {kLibrary[driver]}).RAT);
+    ASSERT_FALSE(result.Buffers.empty());
+    for (const auto &buffer : result.Buffers)
+      EXPECT_NE(buffer.Cell, 2);
+  }
+}
+
+// One engine optimizing net after net gives what fresh engines give
+TEST(BufferInsertVGTest, EngineReuse) {
+  auto netOptions = testNet(80);
+  auto first = generatedNet(netOptions);
+  netOptions.shape = NetGen::Shape::Chain;
+  netOptions.sinks = 30;
+  netOptions.seed = 3;
+  auto second = generatedNet(netOptions);
+
+  VG::Options options;
+  options.Threads = 2;
+  VG::BufferInsertVG engine(kWire, kLibrary, options);
+  for (int run = 0; run < 3; ++run) {
+    SCOPED_TRACE(run);
+    const auto &input = run == 1 ? second : first;
+    if (run == 2)
+      engine.reset();
+    engine.buildRoutingTree(input.edges, input.sinks);
+    auto reused = engine.getOptimParams();
+    auto fresh = optimize(input, options);
+    EXPECT_EQ(reused.RAT, fresh.RAT);
+    EXPECT_EQ(reused.Buffers, fresh.Buffers);
+  }
+}
+
+// The merge rounds of a high-fanout node split over the pool, and give
+// what the serial and the checked merges give
+TEST(BufferInsertVGTest, ParallelMerge) {
+  auto netOptions = testNet(2000, 1000);
+  netOptions.shape = NetGen::Shape::Star;
+  auto input = generatedNet(netOptions);
+
+  // Coarse sites keep the 2000 wires cheap, the merges are what is tested
+  VG::Options options;
+  options.SitePitch = 25;
+  VG::Options checked = options;
+  checked.CheckedMerge = true;
+  auto serial = optimize(input, options);
+  auto reference = optimize(input, checked);
+  EXPECT_EQ(serial.RAT, reference.RAT);
+  EXPECT_EQ(serial.Buffers, reference.Buffers);
+
+  options.Threads = 4;
+  VG::BufferInsertVG engine(kWire, kLibrary, options);
+  engine.buildRoutingTree(input.edges, input.sinks);
+  // Whether another thread takes a pair depends on the schedule, a few
+  // runs make it all but certain
+  VG::PruneStats stats;
+  for (int run = 0; run < 10 && !stats.StolenMerges; ++run) {
+    auto threaded = engine.getOptimParams();
+    EXPECT_EQ(threaded.RAT, serial.RAT);
+    EXPECT_EQ(threaded.Buffers, serial.Buffers);
+    stats = engine.pruneStats();
+    EXPECT_GT(stats.ParallelMerges, 0u);
+  }
+  EXPECT_GT(stats.StolenMerges, 0u);
+
+  // A serial engine never splits a merge
+  options.Threads = 1;
+  VG::BufferInsertVG single(kWire, kLibrary, options);
+  single.buildRoutingTree(input.edges, input.sinks);
+  single.getOptimParams();
+  EXPECT_EQ(single.pruneStats().ParallelMerges, 0u);
+}
+
+// Engine memory is charged to its phases and released with the engine
+TEST(BufferInsertVGTest, MemStats) {
+  auto input = generatedNet(testNet(50));
+  auto before = VG::MemStats::report();
+  VG::MemStats::reset();
+  optimize(input, {}, {kLibrary.front()});
+  auto report = VG::MemStats::report();
+  for (auto phase : {VG::MemPhase::Build, VG::MemPhase::DP,
+                     VG::MemPhase::Merge}) {
+    SCOPED_TRACE(VG::memPhaseName(phase));
+    EXPECT_GT(report.Phases[int(phase)].Allocations, 0u);
+  }
+  EXPECT_GT(report.Total.PeakLive, before.Live);
+  EXPECT_EQ(report.Live, before.Live);
+}
+
+// Buffers go only to sites on the pitch and outside blockages
+TEST(BufferInsertVGTest, BufferSites) {
+  const std::string siteFile = "test_sites.json";
+  std::ofstream(siteFile) << R"({"pitch": 20,
+    "edges": [{"id": 1, "blocked": [[0, 150]]}],
+    "blockages": [[300, -5, 700, 5]]})";
+  auto sites = JSONTools::parseSiteFile(siteFile);
+  std::filesystem::remove(siteFile);
+  EXPECT_EQ(sites.pitch, 20);
+  ASSERT_EQ(sites.blockages.size(), 1u);
+
+  JSONTools::InputData net;
+  net.nodes = {{0, 0, 0, "b", "buf1x"},
+               {1, 1000, 0, "s", "s1"},
+               {2, 1000, 600, "t", "z2", 1.0f, 1000.0f}};
+  net.edges = {{0, {0, 1}, {{0, 0}, {1000, 0}}},
+               {1, {1, 2}, {{1000, 0}, {1000, 600}}}};
+  auto input = engineInput(net);
+  JSONTools::applySiteMap(sites, input.net, input.edges,
+                          input.originalToNewId);
+  VG::Options options;
+  options.SitePitch = sites.pitch;
+  auto result = optimize(input, options, {kLibrary.front()});
+  ASSERT_FALSE(result.Buffers.empty());
+  for (const auto &buffer : result.Buffers) {
+    SCOPED_TRACE(buffer.Len);
+    // The driver
+    if (buffer.ChildID == 0)
+      continue;
+    EXPECT_EQ(buffer.Len % 20, 0);
+    if (buffer.ChildID == input.originalToNewId[1])
+      EXPECT_TRUE(buffer.Len < 300 || buffer.Len > 700);
+    else
+      EXPECT_GT(buffer.Len, 150);
+  }
+
+  // Every unit is a site by default, a coarse pitch cannot do better
+  EXPECT_GE(optimize(input, {}, {kLibrary.front()}).RAT, result.RAT);
+}
+
+// Repeater spacing on long wires stays close to the exact search
+TEST(BufferInsertVGTest, FastWires) {
+  const auto &buffer = kLibrary.front();
+  std::vector<VG::Edge> edges{
+      {0, 3, 100, 0, {}}, {3, 1, 5000, 0, {}}, {3, 2, 3, 0, {}}};
+  std::vector<VG::Node> sinks{{1, {2.0f, 900.0f}}, {2, {0.5f, 1000.0f}}};
+  VG::Options options;
+  options.FastWires = true;
+  VG::BufferInsertVG exact(kWire, buffer);
+  exact.buildRoutingTree(edges, sinks);
+  VG::BufferInsertVG fast(kWire, buffer, options);
+  fast.buildRoutingTree(edges, sinks);
+  auto optimal = exact.getOptimParams();
+  auto result = fast.getOptimParams();
+  EXPECT_LE(result.RAT, optimal.RAT);
+  EXPECT_GE(result.RAT, optimal.RAT - 0.01f * std::abs(optimal.RAT));
+  EXPECT_GT(result.Buffers.size(), 100u);
+
+  // More than one cell keeps the exact search
+  EXPECT_TRUE(VG::BufferInsertVG::fastWires(kWire, {buffer}));
+  EXPECT_FALSE(VG::BufferInsertVG::fastWires(kWire, kLibrary));
+  EXPECT_TRUE(VG::BufferInsertVG::fastWires(
+      kWire, {buffer, {buffer.C, buffer.R, buffer.IntrinsicDel + 1}}));
+  VG::BufferInsertVG library(kWire, kLibrary, options);
+  library.buildRoutingTree(edges, sinks);
+  VG::BufferInsertVG reference(kWire, kLibrary);
+  reference.buildRoutingTree(edges, sinks);
+  EXPECT_EQ(library.getOptimParams().RAT, reference.getOptimParams().RAT);
+}
+
+// Approximate pruning stays within the bound it reports
+TEST(BufferInsertVGTest, ApproximatePruning) {
+  auto netOptions = testNet(100, 1000);
+  netOptions.shape = NetGen::Shape::Star;
+  netOptions.rat = NetGen::Distribution::parse("normal:1500:300");
+  auto input = generatedNet(netOptions);
+  VG::BufferInsertVG exact(kWire, kLibrary);
+  exact.buildRoutingTree(input.edges, input.sinks);
+  auto optimal = exact.getOptimParams().RAT;
+  EXPECT_EQ(exact.pruneStats().RATBound, 0.0);
+
+  for (double epsilon : {0.001, 0.01, 0.05}) {
+    SCOPED_TRACE(epsilon);
+    VG::Options options;
+    options.Epsilon = epsilon;
+    VG::BufferInsertVG approximate(kWire, kLibrary, options);
+    approximate.buildRoutingTree(input.edges, input.sinks);
+    auto rat = approximate.getOptimParams().RAT;
+    auto stats = approximate.pruneStats();
+    EXPECT_LE(rat, optimal);
+    EXPECT_GE(rat, optimal - stats.RATBound - 1e-2);
+    EXPECT_GT(stats.Prunes, 0u);
+    EXPECT_LE(stats.TotalLength, stats.Prunes * stats.LongestList);
+  }
+  VG::Options bad;
+  bad.Epsilon = -0.1;
+  EXPECT_THROW(VG::BufferInsertVG(kWire, kLibrary, bad), std::runtime_error);
+}
+
+// An ECO update gives what a full run gives on the changed net
+TEST(BufferInsertVGTest, IncrementalUpdate) {
+  auto input = generatedNet(testNet(300));
+  auto &net = input.net;
+  VG::Options options;
+  options.Incremental = true;
+  options.Threads = 2;
+  VG::BufferInsertVG engine(kWire, kLibrary, options);
+  EXPECT_THROW(engine.update({}), std::runtime_error);
+  engine.buildRoutingTree(input.edges, input.sinks);
+  engine.getOptimParams();
+
+  // The most critical sink gets later, another one heavier, and the wire
+  // to a third one takes a detour
+  JSONTools::NetDelta delta;
+  auto sink = [&](int nth) {
+    for (const auto &node : net.nodes)
+      if (node.type == "t" && nth-- == 0)
+        return node.id;
+    return -1;
+  };
+  delta.sinks.push_back({sink(0), {}, 1200.0f});
+  delta.sinks.push_back({sink(150), 3.0f, {}});
+  const auto &edge = net.edges[net.edges.size() / 2];
+  auto from = edge.segments.front();
+  auto to = edge.segments.back();
+  delta.edges.push_back(
+      {edge.id, {from, {from[0], from[1] + 700}, {to[0], from[1] + 700}, to}});
+  auto changes = JSONTools::applyDelta(net, delta, input.originalToNewId);
+  ASSERT_EQ(changes.Sinks.size(), 2u);
+  ASSERT_EQ(changes.Edges.size(), 1u);
+
+  auto updated = engine.update(changes);
+  auto full = optimize(engineInput(net));
+  EXPECT_EQ(updated.RAT, full.RAT);
+  EXPECT_EQ(updated.C, full.C);
+  ASSERT_EQ(updated.Buffers.size(), full.Buffers.size());
+  for (size_t i = 0; i < full.Buffers.size(); ++i)
+    EXPECT_FALSE(updated.Buffers[i] != full.Buffers[i]);
+
+  JSONTools::NetDelta steiner;
+  steiner.sinks.push_back({net.edges.front().vertices[1], 1.0f, {}});
+  EXPECT_THROW(JSONTools::applyDelta(net, steiner, input.originalToNewId),
+               std::runtime_error);
+}
+
+// A long series of updates keeps the history it needs and no more, and
+// every update still gives the result of a full run
+TEST(BufferInsertVGTest, UpdateHistoryBounded) {
+  auto input = generatedNet(testNet(100, 3000));
+  VG::Options options;
+  options.Incremental = true;
+  VG::BufferInsertVG engine(kWire, kLibrary, options);
+  engine.buildRoutingTree(input.edges, input.sinks);
+  engine.getOptimParams();
+  auto initial = engine.historyRecords();
+  engine.getOptimParams();
+  EXPECT_EQ(engine.historyRecords(), initial);
+
+  auto sinks = input.sinks;
+  size_t largest = 0;
+  for (int step = 0; step < 60; ++step) {
+    SCOPED_TRACE(step);
+    auto &sink = sinks[step * 7 % sinks.size()];
+    auto crat = sink.CapsRATs.at(0);
+    crat.RAT += step % 2 ? 150.0f : -100.0f;
+    sink.CapsRATs = {crat};
+    auto updated = engine.update({{{sink.ID, crat}}, {}});
+    largest = std::max(largest, engine.historyRecords());
+    if (step % 15)
+      continue;
+    VG::BufferInsertVG fresh(kWire, kLibrary);
+    fresh.buildRoutingTree(input.edges, sinks);
+    auto full = fresh.getOptimParams();
+    EXPECT_EQ(updated.RAT, full.RAT);
+    EXPECT_EQ(updated.Buffers, full.Buffers);
+  }
+  EXPECT_LE(largest, 3 * initial);
+}
+
+// A net optimized in place gives the RAT and buffers of the file flow, and
+// the pieces of every split edge chain its ends through the buffers
+TEST(BufferInsertVGTest, NetView) {
+  auto input = generatedNet(testNet(200));
+  const auto &net = input.net;
+
+  std::vector<VG::NetNode> nodes;
+  std::vector<VG::NetEdge> edges;
+  std::vector<VG::NetPoint> points;
+  for (const auto &node : net.nodes) {
+    auto kind = node.type == "b"   ? VG::NodeKind::Driver
+                : node.type == "t" ? VG::NodeKind::Sink
+                                   : VG::NodeKind::Steiner;
+    nodes.push_back(
+        {node.id, node.x, node.y, kind, node.capacitance, node.rat});
+  }
+  for (const auto &edge : net.edges) {
+    edges.push_back({edge.id, edge.vertices[0], edge.vertices[1],
+                     uint32_t(points.size()), uint32_t(edge.segments.size())});
+    for (const auto &point : edge.segments)
+      points.push_back({point[0], point[1]});
+  }
+  VG::NetOptimizer optimizer(kWire, kLibrary);
+  auto result = optimizer.optimize({nodes, edges, points});
+
+  auto solution = optimize(input);
+  auto buffered =
+      JSONTools::bufferedNet(net, solution.Buffers, input.newToOriginalId);
+  EXPECT_EQ(result.RAT, solution.RAT);
+  ASSERT_EQ(net.nodes.size() + result.Buffers.size(), buffered.nodes.size());
+  ASSERT_FALSE(result.Buffers.empty());
+  EXPECT_EQ(net.edges.size() - result.Split.size() + result.Pieces.size(),
+            buffered.edges.size());
+
+  std::map<int, VG::NetPoint> at;
+  for (const auto &node : nodes)
+    at[node.ID] = {node.X, node.Y};
+  for (size_t i = 0; i < result.Buffers.size(); ++i) {
+    const auto &buffer = result.Buffers[i];
+    const auto &node = buffered.nodes[net.nodes.size() + i];
+    EXPECT_EQ(buffer.ID, node.id);
+    EXPECT_LE(std::abs(buffer.At.X - node.x) + std::abs(buffer.At.Y - node.y),
+              1);
+    at[buffer.ID] = buffer.At;
+  }
+  for (const auto &piece : result.Pieces) {
+    ASSERT_GE(piece.PointCount, 2u);
+    const auto &first = result.Points[piece.FirstPoint];
+    const auto &last = result.Points[piece.FirstPoint + piece.PointCount - 1];
+    EXPECT_EQ(first.X, at[piece.From].X);
+    EXPECT_EQ(first.Y, at[piece.From].Y);
+    EXPECT_EQ(last.X, at[piece.To].X);
+    EXPECT_EQ(last.Y, at[piece.To].Y);
+  }
+
+  // An edge given child first is rejected, not hung on the wrong node
+  for (size_t i : {size_t(0), edges.size() / 2, edges.size() - 1}) {
+    auto reversed = edges;
+    std::swap(reversed[i].From, reversed[i].To);
+    EXPECT_THROW(optimizer.optimize({nodes, reversed, points}),
+                 std::runtime_error);
+  }
+  auto missing = edges;
+  missing.pop_back();
+  EXPECT_THROW(optimizer.optimize({nodes, missing, points}),
+               std::runtime_error);
+  EXPECT_EQ(optimizer.optimize({nodes, edges, points}).RAT, result.RAT);
+
+  nodes.front().Kind = VG::NodeKind::Sink;
+  EXPECT_THROW(optimizer.optimize({nodes, edges, points}),
+               std::runtime_error);
+}
+
+} // namespace
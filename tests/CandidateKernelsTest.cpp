@@ -0,0 +1,58 @@
+#include "CandidateKernels.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Every instruction set the CPU runs gives the scalar results, ties
+// included: on equal values the first candidate is the best buffered one
+TEST(CandidateKernelsTest, MatchScalar) {
+  using VG::Kernels::Isa;
+  auto saved = VG::Kernels::active();
+  std::mt19937 random(11);
+  std::uniform_real_distribution<double> value(0.0, 100.0);
+  std::uniform_int_distribution<int> small(0, 3);
+  for (auto isa : {Isa::SSE2, Isa::AVX2}) {
+    if (!VG::Kernels::select(isa))
+      continue;
+    SCOPED_TRACE(VG::Kernels::name(isa));
+    for (size_t n = 1; n <= 37; ++n) {
+      for (bool tied : {false, true}) {
+        // Tied caps and RATs are binary fractions, RAT - 0.5 * C repeats
+        std::vector<double> c(n), rat(n);
+        for (size_t i = 0; i < n; ++i) {
+          c[i] = tied ? small(random) : value(random);
+          rat[i] = tied ? 0.5 * c[i] + small(random) : value(random);
+        }
+        auto run = [&](Isa target, std::vector<double> &wireC,
+                       std::vector<double> &wireRAT,
+                       std::vector<uint32_t> &kept) {
+          VG::Kernels::select(target);
+          wireC = c;
+          wireRAT = rat;
+          VG::Kernels::applyWire(wireC.data(), wireRAT.data(), n, 0.25, 1.5,
+                                 -3.0);
+          kept.resize(n);
+          kept.resize(VG::Kernels::selectNonDominated(rat.data(), n,
+                                                      kept.data()));
+          return VG::Kernels::bestBuffered(c.data(), rat.data(), n, 0.5);
+        };
+        std::vector<double> scalarC, scalarRAT, vectorC, vectorRAT;
+        std::vector<uint32_t> scalarKept, vectorKept;
+        auto scalarBest = run(Isa::Scalar, scalarC, scalarRAT, scalarKept);
+        auto vectorBest = run(isa, vectorC, vectorRAT, vectorKept);
+        EXPECT_EQ(scalarBest, vectorBest) << n;
+        EXPECT_EQ(scalarC, vectorC) << n;
+        EXPECT_EQ(scalarRAT, vectorRAT) << n;
+        EXPECT_EQ(scalarKept, vectorKept) << n;
+      }
+    }
+    // All equal: the first one wins
+    std::vector<double> c(9, 2.0), rat(9, 7.0);
+    EXPECT_EQ(VG::Kernels::bestBuffered(c.data(), rat.data(), 9, 0.5), 0u);
+  }
+  VG::Kernels::select(saved);
+}
+
+} // namespace
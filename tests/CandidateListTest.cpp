@@ -0,0 +1,37 @@
+#include "CandidateList.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+
+namespace {
+
+// Buffered tails stay in cap order, and the merging prune keeps the same
+// candidates as a sort of the same values
+TEST(CandidateListTest, PruneKeepsOrder) {
+  // Binary fractions keep every value exact in the floats at() returns.
+  // The cap spread exceeds the wire cap of a step, so larger cells land in
+  // the middle of the tail.
+  const VG::TechParams wire{0.25f, 0.125f, 0.0f};
+  const VG::BufferLibrary library{
+      {0.5f, 2.0f, 4.0f}, {1.0f, 1.0f, 5.0f}, {3.0f, 0.25f, 6.0f}};
+  VG::SolutionArena history;
+  VG::CandidateList list{{1.0f, 500.0f}, {2.0f, 520.0f}, {6.0f, 530.0f}};
+  for (int step = 1; step <= 200; ++step) {
+    list.addWire(wire, 1);
+    list.insertBuffers(library, {0, 1, 2}, {0, 1, step}, history);
+    ASSERT_TRUE(list.ordered());
+    if (step % 50)
+      continue;
+    VG::CandidateList shuffled;
+    for (size_t i = list.size(); i-- > 0;)
+      shuffled.push_back(list.at(i));
+    EXPECT_FALSE(shuffled.ordered());
+    list.prune();
+    shuffled.prune();
+    ASSERT_TRUE(list.pruned());
+    ASSERT_EQ(list.size(), shuffled.size());
+    for (size_t i = 0; i < list.size(); ++i)
+      EXPECT_EQ(list.at(i).Hist, shuffled.at(i).Hist);
+  }
+}
+
+} // namespace
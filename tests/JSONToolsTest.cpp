@@ -1,9 +1,11 @@
 #include "JSONTools.h"
-#include "BufferInsertVG.h"
+#include "NetFormat.h"
+#include "TechLibrary.h"
 #include <gtest/gtest.h>
-#include <fstream>
-#include <filesystem>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 
 namespace {
 
@@ -92,57 +94,177 @@ protected:
 
 // Test parsing technology file
 TEST_F(JSONToolsTest, ParseTechFile) {
-  float bufC, bufR, bufDel, unitR, unitC;
-  
-  bool result = JSONHelper::parseTechFile(tempTechFile, bufC, bufR, bufDel, unitR, unitC);
-  
-  EXPECT_TRUE(result);
-  EXPECT_FLOAT_EQ(bufC, 0.5f);
-  EXPECT_FLOAT_EQ(bufR, 2.0f);
-  EXPECT_FLOAT_EQ(bufDel, 4.0f);
-  EXPECT_FLOAT_EQ(unitR, 0.05f);
-  EXPECT_FLOAT_EQ(unitC, 0.3f);
+  auto wire = JSONTools::parseTechFile(tempTechFile);
+  auto buffer = JSONTools::parseBufferParams(tempTechFile);
+
+  EXPECT_FLOAT_EQ(buffer.C, 0.5f);
+  EXPECT_FLOAT_EQ(buffer.R, 2.0f);
+  EXPECT_FLOAT_EQ(buffer.IntrinsicDel, 4.0f);
+  EXPECT_FLOAT_EQ(wire.R, 0.05f);
+  EXPECT_FLOAT_EQ(wire.C, 0.3f);
 }
 
 // Test parsing invalid tech file
 TEST_F(JSONToolsTest, ParseInvalidTechFile) {
-  float bufC, bufR, bufDel, unitR, unitC;
-  
-  bool result = JSONHelper::parseTechFile("no_file.json", bufC, bufR, bufDel, unitR, unitC);
-  
-  EXPECT_FALSE(result);
+  EXPECT_THROW(JSONTools::parseTechFile("no_file.json"), std::runtime_error);
+  EXPECT_THROW(JSONTools::TechLibrary::load("no_file.json"),
+               std::runtime_error);
 }
 
 // Test parsing test file
 TEST_F(JSONToolsTest, ParseTestFile) {
+  auto data = JSONTools::parseTestFile(tempTestFile);
+
+  ASSERT_EQ(data.nodes.size(), 2);
+  ASSERT_EQ(data.edges.size(), 1);
+  EXPECT_EQ(data.nodes[1].x, 90);
+  EXPECT_EQ(data.nodes[1].y, 10);
+  EXPECT_EQ(data.edges[0].segments.size(), 3);
+
   std::vector<VG::Edge> edges;
-  std::vector<VG::Params> capsRATs;
-  std::map<int, std::pair<int, int>> nodeCoords;
-  
-  bool result = JSONHelper::parseTestFile(tempTestFile, edges, capsRATs, nodeCoords);
-  
-  EXPECT_TRUE(result);
-  
+  std::vector<VG::Node> sinks;
+  std::map<int, int> originalToNewId, newToOriginalId;
+  JSONTools::convertToVGStructures(data, edges, sinks, originalToNewId,
+                                   newToOriginalId);
+
   // Check sizes
   EXPECT_EQ(edges.size(), 1);
-  EXPECT_EQ(capsRATs.size(), 1);
-  EXPECT_EQ(nodeCoords.size(), 2);
-  
-  if (capsRATs.size() >= 1) {
-    EXPECT_FLOAT_EQ(capsRATs[0].C, 0.5f);
-    EXPECT_FLOAT_EQ(capsRATs[0].RAT, 200.0f);
+  ASSERT_EQ(sinks.size(), 1);
+  EXPECT_EQ(edges[0].Len, 100);
+  EXPECT_FLOAT_EQ(sinks[0].CapsRATs.at(0).C, 0.5f);
+  EXPECT_FLOAT_EQ(sinks[0].CapsRATs.at(0).RAT, 200.0f);
+}
+
+// Edges without two vertices and a route of two points or more are
+// rejected in both formats
+TEST_F(JSONToolsTest, ParseMalformedEdges) {
+  const std::string nodes = R"("node": [
+      {"id": 0, "x": 0, "y": 0, "type": "b", "name": "buf1x"},
+      {"id": 1, "x": 9, "y": 0, "type": "t", "name": "z0",
+       "capacitance": 0.5, "rat": 200.0}])";
+  for (std::string edge :
+       {R"({"id": 0, "vertices": [0, 1]})",
+        R"({"id": 0, "vertices": [0, 1], "segments": []})",
+        R"({"id": 0, "vertices": [0, 1], "segments": [[0, 0]]})",
+        R"({"id": 0, "vertices": [0], "segments": [[0, 0], [9, 0]]})",
+        R"({"id": 0, "segments": [[0, 0], [9, 0]]})",
+        R"({"id": 0, "vertices": [0, 1], "segments": [[0, 0], [9]]})"}) {
+    SCOPED_TRACE(edge);
+    EXPECT_THROW(JSONTools::parseTestText(
+                     "{" + nodes + R"(, "edge": [)" + edge + "]}", "edge"),
+                 std::runtime_error);
   }
-  
-  // Check coords
-  if (nodeCoords.size() >= 2) {
-    EXPECT_EQ(nodeCoords[0].first, 0);
-    EXPECT_EQ(nodeCoords[0].second, 0);
-    
-    EXPECT_EQ(nodeCoords[1].first, 90);
-    EXPECT_EQ(nodeCoords[1].second, 10);
-    
-    EXPECT_EQ(nodeCoords[3].first, 0);
-    EXPECT_EQ(nodeCoords[3].second, 0);
+
+  const std::string binaryFile = "test_temp_edge.vgnet";
+  auto data = JSONTools::parseTestFile(tempTestFile);
+  data.edges[0].segments.resize(1);
+  NetFormat::writeBinaryNet(binaryFile, data);
+  EXPECT_THROW(NetFormat::NetFile net(binaryFile), std::runtime_error);
+  std::filesystem::remove(binaryFile);
+}
+
+// The second load comes from the cache, a changed file is parsed again
+TEST_F(JSONToolsTest, TechLibraryCache) {
+  auto cacheDir = std::filesystem::temp_directory_path() / "vg_tests_cache";
+  std::filesystem::remove_all(cacheDir);
+  std::filesystem::create_directories(cacheDir);
+  setenv("VG_CACHE_DIR", cacheDir.c_str(), 1);
+
+  auto parsed = JSONTools::TechLibrary::load(tempTechFile);
+  ASSERT_EQ(parsed.cells.size(), 1);
+  EXPECT_EQ(parsed.cellNames[0], "buf1x");
+  ASSERT_EQ(std::distance(std::filesystem::directory_iterator(cacheDir),
+                          std::filesystem::directory_iterator()),
+            1);
+
+  std::ifstream techFile(tempTechFile);
+  std::string text((std::istreambuf_iterator<char>(techFile)),
+                   std::istreambuf_iterator<char>());
+  auto hash = JSONTools::hashBytes(text);
+  JSONTools::TechLibrary cached;
+  ASSERT_TRUE(cached.readCache(JSONTools::techCachePath(hash), hash));
+  EXPECT_FLOAT_EQ(cached.wire.R, 0.05f);
+  EXPECT_FLOAT_EQ(cached.cells[0].IntrinsicDel, 4.0f);
+  EXPECT_EQ(cached.cellNames, parsed.cellNames);
+  EXPECT_FALSE(cached.readCache(JSONTools::techCachePath(hash), hash + 1));
+
+  // Truncated cache is rejected
+  auto cacheFile = JSONTools::techCachePath(hash);
+  std::filesystem::resize_file(cacheFile,
+                               std::filesystem::file_size(cacheFile) - 1);
+  EXPECT_FALSE(cached.readCache(cacheFile, hash));
+  EXPECT_EQ(JSONTools::TechLibrary::load(tempTechFile).cellNames,
+            parsed.cellNames);
+
+  // So is a cell count beyond the file, without allocating for it
+  std::string bytes;
+  {
+    std::ifstream file(cacheFile, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file),
+                 std::istreambuf_iterator<char>());
   }
+  // Magic, version, hash and wire come before the count
+  const size_t countOffset = 4 + 4 + 8 + 12;
+  ASSERT_GT(bytes.size(), countOffset + 4);
+  std::memset(bytes.data() + countOffset, 0xff, 4);
+  std::ofstream(cacheFile, std::ios::binary | std::ios::trunc) << bytes;
+  EXPECT_FALSE(cached.readCache(cacheFile, hash));
+
+  // Without $VG_CACHE_DIR the cache goes to the user's cache directory
+  unsetenv("VG_CACHE_DIR");
+  auto xdg = std::getenv("XDG_CACHE_HOME");
+  std::string savedXdg = xdg ? xdg : "";
+  setenv("XDG_CACHE_HOME", cacheDir.c_str(), 1);
+  EXPECT_EQ(std::filesystem::path(JSONTools::techCachePath(hash))
+                .parent_path(),
+            cacheDir / "vlsiproject");
+  JSONTools::TechLibrary::load(tempTechFile);
+  auto status = std::filesystem::status(cacheDir / "vlsiproject");
+  EXPECT_EQ(status.permissions() & std::filesystem::perms::all,
+            std::filesystem::perms::owner_all);
+  EXPECT_TRUE(std::filesystem::exists(JSONTools::techCachePath(hash)));
+
+  // An empty $VG_CACHE_DIR disables the cache
+  std::filesystem::remove_all(cacheDir);
+  setenv("VG_CACHE_DIR", "", 1);
+  EXPECT_EQ(JSONTools::techCachePath(hash), "");
+  EXPECT_EQ(JSONTools::TechLibrary::load(tempTechFile).cellNames,
+            parsed.cellNames);
+  EXPECT_FALSE(std::filesystem::exists(cacheDir));
+  unsetenv("VG_CACHE_DIR");
+  if (xdg)
+    setenv("XDG_CACHE_HOME", savedXdg.c_str(), 1);
+  else
+    unsetenv("XDG_CACHE_HOME");
+  std::filesystem::remove_all(cacheDir);
 }
-} // namespace
\ No newline at end of file
+
+// JSON -> binary -> JSON keeps the net, damaged binaries are rejected
+TEST_F(JSONToolsTest, BinaryNetRoundTrip) {
+  const std::string binaryFile = "test_temp.vgnet";
+  const std::string jsonFile = "test_temp_rt.json";
+  EXPECT_TRUE(NetFormat::convertNet(tempTestFile, binaryFile));
+  EXPECT_TRUE(NetFormat::isBinaryNet(binaryFile));
+  EXPECT_FALSE(NetFormat::isBinaryNet(tempTestFile));
+  EXPECT_FALSE(NetFormat::convertNet(binaryFile, jsonFile));
+
+  auto original = JSONTools::parseTestFile(tempTestFile);
+  auto binary = NetFormat::readNet(binaryFile);
+  auto json = NetFormat::readNet(jsonFile);
+  for (const auto *data : {&binary, &json}) {
+    ASSERT_EQ(data->nodes.size(), original.nodes.size());
+    ASSERT_EQ(data->edges.size(), original.edges.size());
+    EXPECT_EQ(data->nodes[1].name, "z0");
+    EXPECT_FLOAT_EQ(data->nodes[1].rat, 200.0f);
+    EXPECT_EQ(data->edges[0].vertices, original.edges[0].vertices);
+    EXPECT_EQ(data->edges[0].segments, original.edges[0].segments);
+  }
+
+  std::filesystem::resize_file(binaryFile,
+                               std::filesystem::file_size(binaryFile) - 1);
+  EXPECT_THROW(NetFormat::readNet(binaryFile), std::runtime_error);
+  std::filesystem::remove(binaryFile);
+  std::filesystem::remove(jsonFile);
+}
+
+} // namespace
@@ -0,0 +1,50 @@
+#include "NetFormat.h"
+#include "TestNets.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+
+namespace {
+
+using namespace TestNets;
+
+// A binary net optimized from the mapping gives the RAT and buffers of the
+// JSON flow, and its output file reads back as the same buffered net
+TEST(NetFormatTest, MappedNet) {
+  const std::string binaryFile = "test_mapped.vgnet";
+  const std::string outFile = "test_mapped_out.json";
+  const std::vector<std::string> cellNames{"buf1x", "buf2x"};
+  auto netOptions = testNet(300, 6000);
+  netOptions.seed = 5;
+  auto input = generatedNet(netOptions);
+  NetFormat::writeBinaryNet(binaryFile, input.net);
+
+  NetFormat::NetFile net(binaryFile);
+  EXPECT_EQ(net.driverCell(cellNames), 0);
+  VG::NetOptimizer optimizer(kWire, kLibrary);
+  auto result = optimizer.optimize(net.view(), net.driverCell(cellNames));
+  NetFormat::writeOutputFile(binaryFile, net, result, false, cellNames);
+
+  auto solution = optimize(input);
+  auto expected = JSONTools::bufferedNet(input.net, solution.Buffers,
+                                         input.newToOriginalId, cellNames);
+  EXPECT_EQ(result.RAT, solution.RAT);
+  ASSERT_FALSE(result.Buffers.empty());
+  auto output = JSONTools::parseTestFile(outFile);
+  ASSERT_EQ(output.nodes.size(), expected.nodes.size());
+  ASSERT_EQ(output.edges.size(), expected.edges.size());
+  for (size_t i = 0; i < output.nodes.size(); ++i) {
+    EXPECT_EQ(output.nodes[i].id, expected.nodes[i].id);
+    EXPECT_EQ(output.nodes[i].type, expected.nodes[i].type);
+    EXPECT_EQ(output.nodes[i].name, expected.nodes[i].name);
+    EXPECT_LE(std::abs(output.nodes[i].x - expected.nodes[i].x) +
+                  std::abs(output.nodes[i].y - expected.nodes[i].y),
+              1);
+  }
+  for (size_t i = 0; i < result.Buffers.size(); ++i)
+    EXPECT_EQ(NetFormat::bufferName(net, result.Buffers[i], cellNames),
+              cellNames[result.Buffers[i].Cell]);
+  std::filesystem::remove(binaryFile);
+  std::filesystem::remove(outFile);
+}
+
+} // namespace
@@ -0,0 +1,47 @@
+#include "NetGen.h"
+#include "TestNets.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+
+using namespace TestNets;
+
+// Generated nets are reproducible, survive a round trip through the JSON
+// format and optimize to the same RAT serially and threaded
+TEST(NetGenTest, GeneratedNets) {
+  const std::string netFile = "test_gen.json";
+  for (auto shape : {NetGen::Shape::Steiner, NetGen::Shape::Chain,
+                     NetGen::Shape::HTree, NetGen::Shape::Star}) {
+    SCOPED_TRACE(NetGen::shapeName(shape));
+    auto options = testNet(200);
+    options.shape = shape;
+    options.seed = 7;
+    auto net = NetGen::generate(options);
+    EXPECT_EQ(net.edges.size() + 1, net.nodes.size());
+    auto sinks = std::count_if(net.nodes.begin(), net.nodes.end(),
+                               [](const auto &n) { return n.type == "t"; });
+    EXPECT_EQ(sinks, shape == NetGen::Shape::HTree ? 256 : 200);
+
+    JSONTools::writeTestFile(netFile, net);
+    auto parsed = JSONTools::parseTestFile(netFile);
+    auto again = NetGen::generate(options);
+    ASSERT_EQ(parsed.nodes.size(), again.nodes.size());
+    for (size_t i = 0; i < parsed.nodes.size(); ++i) {
+      EXPECT_EQ(parsed.nodes[i].x, again.nodes[i].x);
+      EXPECT_EQ(parsed.nodes[i].y, again.nodes[i].y);
+      EXPECT_EQ(parsed.nodes[i].rat, again.nodes[i].rat);
+    }
+
+    auto input = engineInput(std::move(parsed));
+    VG::Options threaded;
+    threaded.Threads = 4;
+    EXPECT_EQ(optimize(input).RAT, optimize(input, threaded).RAT);
+  }
+  EXPECT_THROW(NetGen::parseShape("ring"), std::runtime_error);
+  EXPECT_THROW(NetGen::Distribution::parse("normal:1"), std::runtime_error);
+  std::filesystem::remove(netFile);
+}
+
+} // namespace
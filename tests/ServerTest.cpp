@@ -0,0 +1,211 @@
+#include "Server.h"
+#include "NetFormat.h"
+#include "TestNets.h"
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+using namespace TestNets;
+
+// A server on one end of a socket pair, the test is the client on the other
+class ServerStream {
+  int fds[2];
+  std::thread server;
+
+public:
+  explicit ServerStream(const JSONTools::TechLibrary &tech) {
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+      throw std::runtime_error("socketpair failed");
+    server = std::thread([this, &tech] {
+      Server::serveStream(fds[1], fds[1], tech, 2);
+      ::close(fds[1]);
+    });
+  }
+
+  ~ServerStream() {
+    ::shutdown(fds[0], SHUT_WR);
+    if (server.joinable())
+      server.join();
+    ::close(fds[0]);
+  }
+
+  void send(const std::string &bytes) {
+    ASSERT_EQ(::write(fds[0], bytes.data(), bytes.size()),
+              ssize_t(bytes.size()));
+  }
+
+  static std::string frame(const std::string &payload) {
+    return std::to_string(payload.size()) + '\n' + payload;
+  }
+
+  // Ends the requests and collects every reply
+  std::vector<nlohmann::json> replies() {
+    ::shutdown(fds[0], SHUT_WR);
+    std::string stream;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = ::read(fds[0], buffer, sizeof(buffer))) > 0)
+      stream.append(buffer, got);
+    server.join();
+
+    std::vector<nlohmann::json> replies;
+    size_t at = 0;
+    while (at < stream.size()) {
+      auto newline = stream.find('\n', at);
+      EXPECT_NE(newline, std::string::npos);
+      if (newline == std::string::npos)
+        break;
+      auto size = std::stoul(stream.substr(at, newline - at));
+      replies.push_back(
+          nlohmann::json::parse(stream.substr(newline + 1, size)));
+      at = newline + 1 + size;
+    }
+    return replies;
+  }
+};
+
+const JSONTools::TechLibrary kTech{kWire, kLibrary, {"buf1x", "buf2x"}};
+
+nlohmann::json replyWithId(const std::vector<nlohmann::json> &replies,
+                           int id) {
+  for (const auto &reply : replies)
+    if (reply.value("id", -1) == id)
+      return reply;
+  ADD_FAILURE() << "No reply for request " << id;
+  return {};
+}
+
+// Frames come whole, several to a write or a byte at a time, and every
+// request gets its reply, failed ones an error with the request's id
+TEST(ServerTest, Framing) {
+  auto input = generatedNet({});
+  auto net = nlohmann::json::parse(JSONTools::writeTestText(input.net, true));
+  auto solution = optimize(input);
+
+  auto request = [&](int id) {
+    return ServerStream::frame(nlohmann::json{{"id", id}, {"net", net}}.dump());
+  };
+
+  ServerStream stream(kTech);
+  stream.send(request(1) + request(2));
+  for (char c : request(3))
+    stream.send(std::string(1, c));
+  stream.send(ServerStream::frame(R"({"id": 4})"));
+  stream.send(ServerStream::frame(R"({"id": 5, "file": "missing.vgnet"})"));
+  stream.send(ServerStream::frame("[1, 2]"));
+  stream.send(ServerStream::frame("{\"id\": 6,"));
+  auto replies = stream.replies();
+  ASSERT_EQ(replies.size(), 7u);
+
+  for (int id : {1, 2, 3}) {
+    auto reply = replyWithId(replies, id);
+    EXPECT_TRUE(reply["ok"].get<bool>());
+    EXPECT_EQ(reply["rat"].get<float>(), solution.RAT);
+    EXPECT_FALSE(reply.contains("net"));
+  }
+  for (int id : {4, 5}) {
+    auto reply = replyWithId(replies, id);
+    EXPECT_FALSE(reply["ok"].get<bool>());
+    EXPECT_FALSE(reply["error"].get<std::string>().empty());
+    EXPECT_FALSE(reply.contains("rat"));
+  }
+  EXPECT_NE(replyWithId(replies, 5)["error"].get<std::string>().find(
+                "missing.vgnet"),
+            std::string::npos);
+  auto anonymous = std::count_if(
+      replies.begin(), replies.end(), [](const nlohmann::json &reply) {
+        return !reply.contains("id") && !reply["ok"].get<bool>();
+      });
+  EXPECT_EQ(anonymous, 2);
+}
+
+// A broken header or a stream that ends inside a frame gets one error
+// reply, the frames before it are still answered
+TEST(ServerTest, BrokenStream) {
+  auto net = nlohmann::json::parse(
+      JSONTools::writeTestText(generatedNet({}).net, true));
+  auto request = ServerStream::frame(
+      nlohmann::json{{"id", 1}, {"net", net}}.dump());
+  const std::pair<std::string, std::string> broken[] = {
+      {"12x\n", "Malformed frame header"},
+      {"12", "inside a frame header"},
+      {"20\n{\"id\":", "inside a frame"},
+      {"999999999\n", "too large"}};
+  for (const auto &[tail, message] : broken) {
+    SCOPED_TRACE(tail);
+    ServerStream stream(kTech);
+    stream.send(request + tail);
+    auto replies = stream.replies();
+    ASSERT_EQ(replies.size(), 2u);
+    EXPECT_TRUE(replyWithId(replies, 1)["ok"].get<bool>());
+    const auto &error = replies[replies[0].contains("id") ? 1 : 0];
+    EXPECT_FALSE(error["ok"].get<bool>());
+    EXPECT_NE(error["error"].get<std::string>().find(message),
+              std::string::npos);
+  }
+}
+
+// The socket path never replaces a file that is not a socket
+TEST(ServerTest, SocketPath) {
+  const std::string netFile = "test_server_path.json";
+  JSONTools::writeTestFile(netFile, generatedNet({}).net);
+  EXPECT_THROW(Server::serveSocket(netFile, kTech, 1), std::runtime_error);
+  EXPECT_NO_THROW(JSONTools::parseTestFile(netFile));
+  std::filesystem::remove(netFile);
+}
+
+// Net files in either format give the same reply, the topology asked for
+// is the buffered net
+TEST(ServerTest, Files) {
+  const std::string jsonFile = "test_server.json";
+  const std::string binaryFile = "test_server.vgnet";
+  auto input = generatedNet(testNet(150));
+  JSONTools::writeTestFile(jsonFile, input.net);
+  NetFormat::writeBinaryNet(binaryFile, input.net);
+  auto solution = optimize(input);
+  auto buffered = JSONTools::bufferedNet(input.net, solution.Buffers,
+                                         input.newToOriginalId,
+                                         kTech.cellNames);
+
+  ServerStream stream(kTech);
+  stream.send(ServerStream::frame(
+      nlohmann::json{{"id", 1}, {"file", jsonFile}, {"topology", true}}
+          .dump()));
+  stream.send(ServerStream::frame(
+      nlohmann::json{{"id", 2}, {"file", binaryFile}, {"topology", true}}
+          .dump()));
+  stream.send(ServerStream::frame(
+      nlohmann::json{{"id", 3}, {"file", binaryFile}}.dump()));
+  auto replies = stream.replies();
+  ASSERT_EQ(replies.size(), 3u);
+
+  for (int id : {1, 2, 3}) {
+    SCOPED_TRACE(id);
+    auto reply = replyWithId(replies, id);
+    ASSERT_TRUE(reply["ok"].get<bool>()) << reply["error"];
+    EXPECT_EQ(reply["rat"].get<float>(), solution.RAT);
+    const auto &buffers = reply["buffers"];
+    ASSERT_EQ(input.net.nodes.size() + buffers.size(),
+              buffered.nodes.size());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      const auto &node = buffered.nodes[input.net.nodes.size() + i];
+      EXPECT_EQ(buffers[i]["id"].get<int>(), node.id);
+      EXPECT_EQ(buffers[i]["name"].get<std::string>(), node.name);
+    }
+    EXPECT_EQ(reply.contains("net"), id != 3);
+    if (id == 3)
+      continue;
+    auto net = JSONTools::parseTestText(reply["net"].dump(), "reply");
+    EXPECT_EQ(net.nodes.size(), buffered.nodes.size());
+    EXPECT_EQ(net.edges.size(), buffered.edges.size());
+  }
+  std::filesystem::remove(jsonFile);
+  std::filesystem::remove(binaryFile);
+}
+
+} // namespace
@@ -0,0 +1,36 @@
+#include "TestNets.h"
+
+namespace TestNets {
+
+const VG::TechParams kWire{0.3f, 0.05f, 0.0f};
+const VG::BufferLibrary kLibrary{{0.5f, 2.0f, 4.0f}, {1.0f, 1.0f, 5.0f}};
+
+EngineInput engineInput(JSONTools::InputData net) {
+  EngineInput input;
+  input.net = std::move(net);
+  JSONTools::convertToVGStructures(input.net, input.edges, input.sinks,
+                                   input.originalToNewId,
+                                   input.newToOriginalId);
+  return input;
+}
+
+NetGen::Options testNet(int sinks, int span) {
+  NetGen::Options options;
+  options.sinks = sinks;
+  options.span = span;
+  options.rat = NetGen::Distribution::parse("normal:1500:100");
+  return options;
+}
+
+EngineInput generatedNet(const NetGen::Options &options) {
+  return engineInput(NetGen::generate(options));
+}
+
+VG::Solution optimize(const EngineInput &input, const VG::Options &options,
+                      const VG::BufferLibrary &library) {
+  VG::BufferInsertVG engine(kWire, library, options);
+  engine.buildRoutingTree(input.edges, input.sinks);
+  return engine.getOptimParams();
+}
+
+} // namespace TestNets
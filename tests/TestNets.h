@@ -0,0 +1,36 @@
+#pragma once
+
+#include "BufferInsertVG.h"
+#include "JSONTools.h"
+#include "NetGen.h"
+#include <map>
+#include <vector>
+
+// Nets and technology shared by the engine, format and server tests
+namespace TestNets {
+
+// Technology of the engine tests
+extern const VG::TechParams kWire;
+extern const VG::BufferLibrary kLibrary;
+
+// A net and what convertToVGStructures() makes of it
+struct EngineInput {
+  JSONTools::InputData net;
+  std::vector<VG::Edge> edges;
+  std::vector<VG::Node> sinks;
+  std::map<int, int> originalToNewId;
+  std::map<int, int> newToOriginalId;
+};
+
+EngineInput engineInput(JSONTools::InputData net);
+
+// Generator options of the usual test net: a Steiner tree with the given
+// sinks on a die of the given span, sink RATs normal around 1500
+NetGen::Options testNet(int sinks, int span = 5000);
+EngineInput generatedNet(const NetGen::Options &options);
+
+// A fresh engine run on the net
+VG::Solution optimize(const EngineInput &input, const VG::Options &options = {},
+                      const VG::BufferLibrary &library = kLibrary);
+
+} // namespace TestNets
@@ -0,0 +1,271 @@
+#include "BufferInsertVG.h"
+#include "CandidateKernels.h"
+#include "CandidateList.h"
+#include "JSONTools.h"
+#include "NetFormat.h"
+#include "NetGen.h"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <random>
+
+// Engine and I/O benchmarks on generated nets. Run with
+//   VG_bench --benchmark_out=bench.json --benchmark_out_format=json
+// (or the bench_json target) and compare the files across commits.
+
+namespace {
+
+const VG::TechParams unitWire{0.3f, 0.05f, 0.0f};
+const VG::BufferLibrary library{{0.5f, 2.0f, 4.0f}, {1.0f, 1.0f, 5.0f},
+                                {2.0f, 0.5f, 6.0f}};
+
+// Builds the net node by node: driver 0, Steiner points and sinks with
+// L-shaped wires
+class NetBuilder {
+  JSONTools::InputData net;
+  std::mt19937 rng{42};
+
+public:
+  NetBuilder() { net.nodes.push_back({0, 0, 0, "b", "buf1x"}); }
+
+  int add(int parent, int dx, int dy, bool sink) {
+    const auto &from = net.nodes[parent];
+    int id = net.nodes.size();
+    std::string name = sink ? "z" : "s";
+    name += std::to_string(id);
+    JSONTools::InputNode node{id, from.x + dx, from.y + dy, sink ? "t" : "s",
+                              name};
+    if (sink) {
+      node.capacitance = std::uniform_real_distribution<float>(0.5f, 5.0f)(rng);
+      node.rat = std::uniform_real_distribution<float>(1e3f, 2e3f)(rng);
+    }
+    net.edges.push_back({int(net.edges.size()),
+                         {parent, id},
+                         {{from.x, from.y}, {node.x, from.y}, {node.x, node.y}}});
+    net.nodes.push_back(node);
+    return id;
+  }
+
+  // Balanced tree of the given fanout over sinks, every edge len long
+  void tree(int parent, int sinks, int fanout, int len) {
+    if (sinks == 1) {
+      add(parent, len, 0, true);
+      return;
+    }
+    int steiner = add(parent, len, 0, false);
+    int children = std::min(fanout, sinks);
+    for (int i = 0; i < children; ++i) {
+      int share = sinks / children + (i < sinks % children);
+      tree(steiner, share, fanout, len);
+    }
+  }
+
+  // Steiner points in a row, a short sink hangs off each of them
+  void chain(int depth, int len) {
+    int parent = 0;
+    for (int i = 0; i < depth; ++i) {
+      parent = add(parent, len, 0, false);
+      add(parent, 0, 2, true);
+    }
+  }
+
+  const JSONTools::InputData &data() const { return net; }
+};
+
+struct EngineInput {
+  std::vector<VG::Edge> edges;
+  std::vector<VG::Node> sinks;
+};
+
+EngineInput engineInput(JSONTools::InputData net) {
+  EngineInput input;
+  std::map<int, int> originalToNewId, newToOriginalId;
+  JSONTools::convertToVGStructures(net, input.edges, input.sinks,
+                                   originalToNewId, newToOriginalId);
+  return input;
+}
+
+void optimize(benchmark::State &state, const JSONTools::InputData &net,
+              unsigned threads = 1) {
+  auto input = engineInput(net);
+  VG::Options options;
+  options.Threads = threads;
+  VG::BufferInsertVG engine(unitWire, library, options);
+  size_t buffers = 0;
+  for (auto _ : state) {
+    engine.buildRoutingTree(input.edges, input.sinks);
+    auto solution = engine.getOptimParams();
+    buffers = solution.Buffers.size();
+    benchmark::DoNotOptimize(solution.RAT);
+  }
+  state.counters["nodes"] = net.nodes.size();
+  state.counters["buffers"] = buffers;
+  state.SetItemsProcessed(state.iterations() * net.nodes.size());
+}
+
+// Two-pin net, the DP cost grows with the number of buffer sites
+void BM_WireLength(benchmark::State &state) {
+  NetBuilder net;
+  net.add(0, state.range(0), 0, true);
+  optimize(state, net.data());
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_WireLength)->RangeMultiplier(4)->Range(64, 16384)->Complexity();
+
+void BM_Sinks(benchmark::State &state) {
+  NetBuilder net;
+  net.tree(0, state.range(0), 2, 20);
+  optimize(state, net.data());
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Sinks)->RangeMultiplier(4)->Range(16, 4096)->Complexity();
+
+void BM_Fanout(benchmark::State &state) {
+  NetBuilder net;
+  net.tree(0, 512, state.range(0), 20);
+  optimize(state, net.data());
+}
+BENCHMARK(BM_Fanout)->DenseRange(2, 8, 2)->Arg(16)->Arg(64);
+
+// Deep chains stress the tree walk rather than the candidate lists
+void BM_Depth(benchmark::State &state) {
+  NetBuilder net;
+  net.chain(state.range(0), 4);
+  optimize(state, net.data());
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Depth)->RangeMultiplier(4)->Range(64, 65536)->Complexity();
+
+void BM_Threads(benchmark::State &state) {
+  NetBuilder net;
+  net.tree(0, 4096, 4, 30);
+  optimize(state, net.data(), state.range(0));
+}
+BENCHMARK(BM_Threads)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+// Unsorted candidates with random dominance, as left by buffering and
+// merging
+void BM_Prune(benchmark::State &state) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> caps(1.0f, 1000.0f);
+  std::uniform_real_distribution<float> rats(0.0f, 1000.0f);
+  std::vector<VG::Params> candidates(state.range(0));
+  for (auto &candidate : candidates)
+    candidate = {caps(rng), rats(rng)};
+  for (auto _ : state) {
+    state.PauseTiming();
+    VG::CandidateList list;
+    for (const auto &candidate : candidates)
+      list.push_back(candidate);
+    state.ResumeTiming();
+    list.prune();
+    benchmark::DoNotOptimize(list.size());
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Prune)->RangeMultiplier(4)->Range(64, 65536)->Complexity();
+
+// Two long branches merged at the root, the lists are as long as the wires
+void BM_MergeBranch(benchmark::State &state) {
+  NetBuilder net;
+  net.add(0, 0, state.range(0), true);
+  net.add(0, 0, -state.range(0), true);
+  optimize(state, net.data());
+}
+BENCHMARK(BM_MergeBranch)->RangeMultiplier(4)->Range(256, 16384);
+
+// Generated nets of shape x sinks on a 5000 unit die
+void BM_GeneratedNet(benchmark::State &state) {
+  NetGen::Options options;
+  options.shape = NetGen::Shape(state.range(0));
+  options.sinks = state.range(1);
+  options.span = 5000;
+  optimize(state, NetGen::generate(options));
+  state.SetLabel(NetGen::shapeName(options.shape));
+}
+BENCHMARK(BM_GeneratedNet)
+    ->ArgsProduct({{int(NetGen::Shape::Steiner), int(NetGen::Shape::Chain),
+                    int(NetGen::Shape::HTree), int(NetGen::Shape::Star)},
+                   {256, 2048}})
+    ->ArgNames({"shape", "sinks"})
+    ->Unit(benchmark::kMillisecond);
+
+// Net files of the given sink count in the working directory
+class NetFiles {
+  std::string base;
+
+public:
+  JSONTools::InputData net;
+
+  explicit NetFiles(int sinks)
+      : base("vg_bench_" + std::to_string(sinks)) {
+    NetBuilder builder;
+    builder.tree(0, sinks, 3, 25);
+    net = builder.data();
+    JSONTools::writeTestFile(json(), net);
+    NetFormat::writeBinaryNet(binary(), net);
+  }
+  ~NetFiles() {
+    std::filesystem::remove(json());
+    std::filesystem::remove(binary());
+    std::filesystem::remove(base + "_out.json");
+  }
+
+  std::string json() const { return base + ".json"; }
+  std::string binary() const { return base + ".vgnet"; }
+};
+
+void BM_ParseTestFile(benchmark::State &state) {
+  NetFiles files(state.range(0));
+  for (auto _ : state)
+    benchmark::DoNotOptimize(JSONTools::parseTestFile(files.json()));
+  state.SetBytesProcessed(state.iterations() *
+                          std::filesystem::file_size(files.json()));
+}
+BENCHMARK(BM_ParseTestFile)->RangeMultiplier(8)->Range(64, 32768);
+
+// What the optimizer reads of a binary net: the mapping and the node kinds
+void BM_ReadBinaryNet(benchmark::State &state) {
+  NetFiles files(state.range(0));
+  for (auto _ : state) {
+    NetFormat::NetFile net(files.binary());
+    benchmark::DoNotOptimize(net.view());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          std::filesystem::file_size(files.binary()));
+}
+BENCHMARK(BM_ReadBinaryNet)->RangeMultiplier(8)->Range(64, 32768);
+
+void BM_WriteOutputFile(benchmark::State &state) {
+  NetFiles files(state.range(0));
+  auto net = files.net;
+  std::vector<VG::Edge> edges;
+  std::vector<VG::Node> sinks;
+  std::map<int, int> originalToNewId, newToOriginalId;
+  JSONTools::convertToVGStructures(net, edges, sinks, originalToNewId,
+                                   newToOriginalId);
+  VG::BufferInsertVG engine(unitWire, library);
+  engine.buildRoutingTree(edges, sinks);
+  auto solution = engine.getOptimParams();
+  std::vector<std::string> cellNames{"buf1x", "buf2x", "buf4x"};
+  for (auto _ : state)
+    JSONTools::writeOutputFile(files.json(), files.net, solution.Buffers,
+                               newToOriginalId, false, cellNames,
+                               state.range(1));
+  state.counters["buffers"] = solution.Buffers.size();
+}
+BENCHMARK(BM_WriteOutputFile)
+    ->ArgsProduct({{64, 512, 4096, 32768}, {0, 1}})
+    ->ArgNames({"sinks", "compact"});
+
+} // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::AddCustomContext("vg_kernels",
+                              VG::Kernels::name(VG::Kernels::active()));
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}